@@ -0,0 +1,251 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "chance_store.h"
+
+// Maintenance tool for the Game of Chance player store. Every command that
+// rewrites the file takes a whole-file lock first, and refuses to run while
+// games have the file open, since they would keep using the old file.
+
+#define CSV_LINE_MAX 512
+
+static void usage(void) {
+    fprintf(stderr, "Usage: chance_admin migrate [file]\n");
+    fprintf(stderr, "       chance_admin compact [file] [min_slot_size]\n");
+    fprintf(stderr, "       chance_admin export [file] > players.csv\n");
+    fprintf(stderr, "       chance_admin import <players.csv> [file]\n");
+    fprintf(stderr, "The file defaults to %s. Rewrites refuse to run while games are being played.\n", DATAFILE);
+}
+
+static long file_size(const char *path) {
+    struct stat st;
+    return (stat(path, &st) == -1) ? -1 : (long)st.st_size;
+}
+
+// Loads path under a whole-file lock. Returns the lock descriptor or -1.
+static int load_locked(const char *path, struct store_record **records, size_t *count) {
+    int lock_fd = store_lock_exclusive(path);
+
+    if (lock_fd == -1 && errno == EBUSY) {
+        fprintf(stderr, "Error: %s is open in running games; stop them first\n", path);
+        return -1;
+    }
+    if (lock_fd == -1 || store_load_fd(lock_fd, records, count) == -1) {
+        fprintf(stderr, "Error: could not read %s: %s\n", path, strerror(errno));
+        if (lock_fd != -1)
+            close(lock_fd);
+        return -1;
+    }
+    return lock_fd;
+}
+
+// Saves records over path, reporting the change in size
+static int save_report(const char *path, const struct store_record *records, size_t count, uint32_t slot_size) {
+    long before = file_size(path);
+    int written = store_save(path, records, count, slot_size);
+
+    if (written == -1) {
+        fprintf(stderr, "Error: could not write %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    fprintf(stderr, "%s: %d players, %u-byte records, %ld -> %ld bytes\n",
+            path, written, slot_size, before < 0 ? 0 : before, file_size(path));
+    return 0;
+}
+
+// Rewrites the file in the current format, keeping the original as <file>.bak
+static int cmd_migrate(const char *path) {
+    struct store_record *records;
+    size_t count;
+    int lock_fd, result;
+
+    if ((lock_fd = load_locked(path, &records, &count)) == -1)
+        return 1;
+    if (store_backup(path) == -1) {
+        fprintf(stderr, "Error: could not back up %s to %s.bak: %s\n", path, path, strerror(errno));
+        result = 1;
+    } else {
+        result = save_report(path, records, count, store_fit_slot_size(records, count, STORE_SLOT_SIZE));
+    }
+    free(records);
+    close(lock_fd);
+    return result;
+}
+
+// Rewrites the file with the smallest slots and capacity that hold it. Names
+// are then limited to the longest in the file, unless minimum allows more.
+static int cmd_compact(const char *path, uint32_t minimum) {
+    struct store_record *records;
+    size_t count;
+    int lock_fd, result;
+
+    if ((lock_fd = load_locked(path, &records, &count)) == -1)
+        return 1;
+    result = save_report(path, records, count, store_fit_slot_size(records, count, minimum));
+    free(records);
+    close(lock_fd);
+    return result;
+}
+
+// Writes one CSV field, quoting it if needed
+static void csv_field(FILE *out, const char *field) {
+    if (strpbrk(field, ",\"\n\r") == NULL) {
+        fputs(field, out);
+        return;
+    }
+    fputc('"', out);
+    for (; *field; field++) {
+        if (*field == '"')
+            fputc('"', out);
+        fputc(*field, out);
+    }
+    fputc('"', out);
+}
+
+// Prints every player as uid,credits,highscore,name
+static int cmd_export(const char *path) {
+    struct store_record *records;
+    size_t count;
+
+    if (store_load(path, &records, &count) == -1) {
+        fprintf(stderr, "Error: could not read %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    printf("uid,credits,highscore,name\n");
+    for (size_t i = 0; i < count; i++) {
+        printf("%d,%d,%d,", records[i].uid, records[i].credits, records[i].highscore);
+        csv_field(stdout, records[i].name);
+        putchar('\n');
+    }
+    free(records);
+    return 0;
+}
+
+// Parses one CSV line as written by cmd_export. Returns 0 on success, -1 for
+// a malformed line and -2 for a name too long for a record.
+static int csv_parse(char *line, struct store_record *record) {
+    char *p = line, *name = record->name;
+    int consumed;
+
+    memset(record, 0, sizeof(*record));
+    if (sscanf(p, "%d,%d,%d,%n", &record->uid, &record->credits, &record->highscore, &consumed) != 3)
+        return -1;
+    p += consumed;
+    if (*p == '"') {
+        for (p++; *p && !(*p == '"' && p[1] != '"'); p++) {
+            if (*p == '"')
+                p++; // Doubled quote
+            if (name == record->name + STORE_NAME_LEN - 1)
+                return -2;
+            *name++ = *p;
+        }
+    } else {
+        for (; *p && *p != '\n' && *p != '\r'; p++) {
+            if (name == record->name + STORE_NAME_LEN - 1)
+                return -2;
+            *name++ = *p;
+        }
+    }
+    return 0;
+}
+
+static int compare_uid(const void *a, const void *b) {
+    const struct store_record *x = a, *y = b;
+    return (x->uid > y->uid) - (x->uid < y->uid);
+}
+
+// Adds or replaces players from a CSV file written by export. A missing
+// store file is created.
+static int cmd_import(const char *csv_path, const char *path) {
+    struct store_record *records = NULL, record, *found, *grown;
+    size_t count = 0, added = 0, replaced = 0, capacity;
+    char line[CSV_LINE_MAX];
+    int lock_fd = -1, line_number = 0, result = 1;
+    FILE *csv = fopen(csv_path, "r");
+
+    if (csv == NULL) {
+        fprintf(stderr, "Error: could not open %s: %s\n", csv_path, strerror(errno));
+        return 1;
+    }
+    if (file_size(path) > 0) {
+        if ((lock_fd = load_locked(path, &records, &count)) == -1)
+            goto out;
+    } else if ((records = calloc(1, sizeof(*records))) == NULL) {
+        goto out;
+    }
+    capacity = count ? count : 1;
+    qsort(records, count, sizeof(*records), compare_uid); // For lookups; store_save keeps the order given
+
+    while (fgets(line, sizeof(line), csv) != NULL) {
+        line_number++;
+        if (line_number == 1 && strncmp(line, "uid,", 4) == 0)
+            continue; // Header row
+        switch (csv_parse(line, &record)) {
+        case -1:
+            fprintf(stderr, "%s:%d: skipping malformed row\n", csv_path, line_number);
+            continue;
+        case -2:
+            fprintf(stderr, "%s:%d: skipping row, name over %d bytes\n", csv_path, line_number, STORE_NAME_LEN - 1);
+            continue;
+        }
+        found = bsearch(&record, records, count - added, sizeof(*records), compare_uid);
+        if (found != NULL) {
+            *found = record;
+            replaced++;
+            continue;
+        }
+        if (count == capacity) {
+            capacity *= 2;
+            if ((grown = realloc(records, capacity * sizeof(*records))) == NULL)
+                goto out;
+            records = grown;
+        }
+        records[count++] = record;
+        added++;
+    }
+    // store_save keeps the first row for a uid; reverse the new rows so the
+    // last one in the CSV wins, as it does for players already in the file
+    for (size_t i = count - added, j = count; i + 1 < j; i++) {
+        j--;
+        record = records[i];
+        records[i] = records[j];
+        records[j] = record;
+    }
+    fprintf(stderr, "%s: %zu new rows, %zu replaced\n", csv_path, added, replaced);
+    result = save_report(path, records, count, store_fit_slot_size(records, count, STORE_SLOT_SIZE));
+
+out:
+    fclose(csv);
+    free(records);
+    if (lock_fd != -1)
+        close(lock_fd);
+    return result;
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = DATAFILE;
+
+    if (argc < 2) {
+        usage();
+        return 1;
+    }
+    if (strcmp(argv[1], "migrate") == 0 && argc <= 3) {
+        return cmd_migrate(argc > 2 ? argv[2] : path);
+    } else if (strcmp(argv[1], "compact") == 0 && argc <= 4) {
+        int minimum = argc > 3 ? atoi(argv[3]) : 0;
+        if (minimum < 0 || minimum > STORE_MAX_SLOT_SIZE) {
+            usage();
+            return 1;
+        }
+        return cmd_compact(argc > 2 ? argv[2] : path, minimum);
+    } else if (strcmp(argv[1], "export") == 0 && argc <= 3) {
+        return cmd_export(argc > 2 ? argv[2] : path);
+    } else if (strcmp(argv[1], "import") == 0 && (argc == 3 || argc == 4)) {
+        return cmd_import(argv[2], argc > 3 ? argv[3] : path);
+    }
+    usage();
+    return 1;
+}
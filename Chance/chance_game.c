@@ -0,0 +1,488 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include "chance_rules.h"
+#include "chance_game.h"
+
+// ============================== Output ====================================
+
+static void game_printf(struct game *g, const char *format, ...) {
+    char buffer[512], *text = buffer;
+    va_list args;
+    int length;
+
+    va_start(args, format);
+    length = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (length < 0)
+        return;
+    if ((size_t)length >= sizeof(buffer)) {
+        if ((text = malloc(length + 1)) == NULL)
+            return;
+        va_start(args, format);
+        vsnprintf(text, length + 1, format, args);
+        va_end(args);
+    }
+    g->frontend->write(g->context, text, length);
+    if (text != buffer)
+        free(text);
+}
+
+// ============================== Players ===================================
+
+// Writes the player's changes to their slot. Credits go as the change since
+// the last sync, so other sessions of the same player don't lose their
+// winnings; the merged record is then reloaded from the store.
+void game_player_sync(struct store *store, struct game_player *player) {
+    struct store_record merged;
+
+    store_apply(store, player->slot, player->record.credits - player->synced_credits,
+                player->name_dirty ? player->record.name : NULL, &merged);
+    player->record = merged;
+    player->synced_credits = merged.credits;
+    player->dirty = player->name_dirty = 0;
+}
+
+// Marks a change to the player and hands it to the front end to save
+static void player_changed(struct game *g) {
+    struct game_player *p = g->player;
+
+    if (p->record.credits > p->record.highscore)
+        p->record.highscore = p->record.credits;
+    p->dirty = 1;
+    g->frontend->changed(g->context, p);
+}
+
+// ================================ Menu ====================================
+
+static void show_menu(struct game *g) {
+    game_printf(g, "-=[ Game of Chance Menu ]=-\n");
+    game_printf(g, "1 - Play the Pick a Number game\n");
+    game_printf(g, "2 - Play the No Match Dealer game\n");
+    game_printf(g, "3 - Play the Find the Ace game\n");
+    game_printf(g, "4 - View current high score\n");
+    game_printf(g, "5 - Change your user name\n");
+    game_printf(g, "6 - Reset your account at 100 credits\n");
+    game_printf(g, "7 - Quit\n");
+    game_printf(g, "[Name: %s]\n", g->player->record.name);
+    game_printf(g, "[You have %u credits] -> ", g->player->record.credits);
+    g->state = GAME_MENU;
+}
+
+// Prints the 3 cards for the Find the Ace game
+static void print_cards(struct game *g, const char *message, const char *cards, int user_pick) {
+    game_printf(g, "\n\t*** %s ***\n", message);
+    game_printf(g, " \t._.\t._.\t._.\n");
+    game_printf(g, "Cards:\t|%c|\t|%c|\t|%c|\n\t", cards[0], cards[1], cards[2]);
+
+    if (user_pick == -1) {
+        game_printf(g, " 1 \t 2 \t 3\n");
+    } else {
+        for (int i = 0; i < user_pick; i++)
+            game_printf(g, "\t");
+        game_printf(g, " ^-- your pick\n");
+    }
+}
+
+// Takes stake credits from the player's stored record, after syncing their
+// pending changes. Returns -1 if the store holds too few: the local credits
+// may be stale while other sessions of the player are also wagering.
+static int reserve_credits(struct game *g, int stake) {
+    struct game_player *p = g->player;
+    struct store_record merged;
+    int reserved;
+
+    game_player_sync(g->store, p);
+    reserved = store_reserve(g->store, p->slot, stake, &merged);
+    p->record = merged;
+    p->synced_credits = merged.credits;
+    return reserved;
+}
+
+// Asks for a wager. A raise in Find the Ace counts the first wager, which is
+// already taken, as still available.
+static void ask_wager(struct game *g, enum game_state state) {
+    int staked = (state == GAME_ACE_RAISE) ? g->wager_one : 0;
+
+    game_printf(g, "How many of your %d credits would you like to wager? ", g->player->record.credits + staked);
+    g->state = state;
+}
+
+// Handles wagers for the games, returns -1 if the wager is invalid.
+// A valid wager is taken from the player's credits until the round ends.
+static int take_wager(struct game *g, int wager, int previous_wager) {
+    if (wager < 1) {
+        game_printf(g, "Nice try, but you must wager a positive number!\n");
+        return -1;
+    }
+    if (reserve_credits(g, wager) == -1) {
+        game_printf(g, "Your total wager of %d is more than you have!\n", previous_wager + wager);
+        game_printf(g, "You only have %d available credits, try again.\n",
+                    g->player->record.credits + previous_wager);
+        return -1;
+    }
+    return wager;
+}
+
+// Starts a round of the current game, or returns to the menu if the player
+// can't afford one
+static void play_the_game(struct game *g) {
+    if (g->debug)
+        game_printf(g, "\n[DEBUG] current_game pointer @ 0x%08lx\n", (unsigned long)g->current_game);
+    if (g->current_game(g) == -1)
+        show_menu(g);
+}
+
+// A round is over: save it and offer another
+static void finish_round(struct game *g) {
+    player_changed(g);
+    game_printf(g, "\nYou now have %u credits\n", g->player->record.credits);
+    game_printf(g, "Would you like to play again? (y/n) ");
+    g->state = GAME_PLAY_AGAIN;
+}
+
+// ================================ Games ===================================
+
+// This function is the Pick a Number game.
+// It returns -1 if the player doesn't have enough credits.
+static int pick_a_number(struct game *g) {
+    struct store_record *p = &g->player->record;
+
+    game_printf(g, "\n####### Pick a Number ######\n");
+    game_printf(g, "This game costs 10 credits to play. Simply pick a number\n");
+    game_printf(g, "between 1 and 20, and if you pick the winning number, you\n");
+    game_printf(g, "will win the jackpot of 100 credits!\n\n");
+
+    g->winning_number = (rand() % PICK_RANGE) + 1; // Pick a number between 1 and 20.
+
+    if (reserve_credits(g, PICK_COST) == -1) { // Deduct 10 credits.
+        game_printf(g, "You only have %d credits. That's not enough to play!\n\n", p->credits);
+        return -1; // Not enough credits to play
+    }
+
+    game_printf(g, "10 credits have been deducted from your account.\n");
+    game_printf(g, "Pick a number between 1 and 20: ");
+    g->state = GAME_PICK_NUMBER;
+    return 0;
+}
+
+static void pick_result(struct game *g, int pick) {
+    game_printf(g, "The winning number is %d\n", g->winning_number);
+    if (pick == g->winning_number) {
+        game_printf(g, "*+*+*+*+*+* JACKPOT *+*+*+*+*+*\n");
+        game_printf(g, "You have won the jackpot of 100 credits!\n");
+        g->player->record.credits += PICK_JACKPOT;
+    } else {
+        game_printf(g, "Sorry, you didn't win.\n");
+    }
+    finish_round(g);
+}
+
+// This is the No Match Dealer game.
+// It returns -1 if the player has 0 credits.
+static int dealer_no_match(struct game *g) {
+    game_printf(g, "\n::::::: No Match Dealer :::::::\n");
+    game_printf(g, "In this game, you can wager up to all of your credits.\n");
+    game_printf(g, "The dealer will deal out 16 random numbers between 0 and 99.\n");
+    game_printf(g, "If there are no matches among them, you double your money!\n\n");
+
+    game_player_sync(g->store, g->player); // Credits as other sessions left them
+    if (g->player->record.credits == 0) {
+        game_printf(g, "You don't have any credits to wager!\n\n");
+        return -1;
+    }
+    ask_wager(g, GAME_DEALER_WAGER);
+    return 0;
+}
+
+static void dealer_result(struct game *g, int wager) {
+    int numbers[DEALER_NUMBERS], match;
+
+    game_printf(g, "\t\t::: Dealing out 16 random numbers :::\n");
+    for (int i = 0; i < DEALER_NUMBERS; i++) {
+        numbers[i] = rand() % DEALER_RANGE; // Pick a number between 0 and 99.
+        game_printf(g, "%2d\t", numbers[i]);
+        if (i % 8 == 7) // Print a line break every 8 numbers.
+            game_printf(g, "\n");
+    }
+
+    match = first_match(numbers, DEALER_NUMBERS); // Check for matches
+    if (match != -1) {
+        game_printf(g, "The dealer matched the number %d!\n", match);
+        game_printf(g, "You lose %d credits.\n", wager); // Already taken
+    } else {
+        game_printf(g, "There were no matches! You win %d credits!\n", wager);
+        g->player->record.credits += 2 * wager; // The wager back, and the win
+    }
+    finish_round(g);
+}
+
+// This is the Find the Ace game.
+// It returns -1 if the player has 0 credits.
+static int find_the_ace(struct game *g) {
+    g->ace = rand() % 3; // Place the ace randomly.
+    g->wager_two = -1;
+    game_printf(g, "******* Find the Ace *******\n");
+    game_printf(g, "In this game, you can wager up to all of your credits.\n");
+    game_printf(g, "Three cards will be dealt out, two queens and one ace.\n");
+    game_printf(g, "If you find the ace, you will win your wager.\n");
+    game_printf(g, "After choosing a card, one of the queens will be revealed.\n");
+    game_printf(g, "At this point, you may either select a different card or\n");
+    game_printf(g, "increase your wager.\n\n");
+
+    game_player_sync(g->store, g->player); // Credits as other sessions left them
+    if (g->player->record.credits == 0) {
+        game_printf(g, "You don't have any credits to wager!\n\n");
+        return -1;
+    }
+    ask_wager(g, GAME_ACE_WAGER);
+    return 0;
+}
+
+static void ace_choice_prompt(struct game *g) {
+    game_printf(g, "Would you like to:\n[c]hange your pick\tor\t[i]ncrease your wager?\n");
+    game_printf(g, "Select c or i: ");
+    g->state = GAME_ACE_CHOICE;
+}
+
+static void ace_result(struct game *g) {
+    char cards[3];
+    int won = (g->pick == g->ace), staked = g->wager_one;
+
+    // Reveal all cards and display results
+    for (int i = 0; i < 3; i++)
+        cards[i] = (i == g->ace) ? 'A' : 'Q';
+    print_cards(g, "End result", cards, g->pick);
+
+    game_printf(g, "You have %s %d credits from your first wager\n", won ? "won" : "lost", g->wager_one);
+    if (g->wager_two != -1) {
+        game_printf(g, "and an additional %d credits from your second wager!\n", g->wager_two);
+        staked += g->wager_two;
+    }
+    if (won) // The wagers were taken when made
+        g->player->record.credits += 2 * staked;
+    finish_round(g);
+}
+
+// ============================== Leaderboard ===============================
+
+// Shows one page of the leaderboard, asking whether to continue if more remain
+static void show_scores_page(struct game *g) {
+    struct store_record entry;
+
+    game_printf(g, "------------------------------------------------------\n");
+    for (int i = g->page * SCORES_PER_PAGE; i < g->top_count && i < (g->page + 1) * SCORES_PER_PAGE; i++) {
+        store_get(g->store, g->top[i].slot, &entry);
+        game_printf(g, "%4d. %-40.40s %8d\n", i + 1, entry.name, g->top[i].score);
+    }
+    g->page++;
+
+    if (g->page * SCORES_PER_PAGE < g->top_count) {
+        game_printf(g, "Show the next %d scores? (y/n) ", SCORES_PER_PAGE);
+        g->state = GAME_SCORES_MORE;
+    } else {
+        game_printf(g, "======================================================\n\n");
+        show_menu(g);
+    }
+}
+
+// Displays the current high score, then the leaderboard a page at a time
+static void show_highscore(struct game *g) {
+    struct store_record *p = &g->player->record, leader;
+
+    if (g->frontend->flush != NULL)
+        g->frontend->flush(g->context); // The board only reflects saved high scores
+    game_printf(g, "\n====================| HIGH SCORE |====================\n");
+    g->top_count = store_top(g->store, g->top, STORE_BOARD_SIZE);
+    if (g->top_count > 0 && g->top[0].uid != p->uid && g->top[0].score > p->highscore) {
+        store_get(g->store, g->top[0].slot, &leader);
+        game_printf(g, "%s has the high score of %u\n", leader.name, g->top[0].score);
+    } else
+        game_printf(g, "You have the high score of %u\n", p->highscore);
+    g->page = 0;
+    if (g->top_count == 0) {
+        game_printf(g, "======================================================\n\n");
+        show_menu(g);
+        return;
+    }
+    show_scores_page(g);
+}
+
+// ============================ Registration ================================
+
+// Checks that a name fits the store's slots, and asks again if it doesn't
+static int name_fits(struct game *g, const char *name, const char *prompt) {
+    int longest = store_name_max(g->store);
+
+    if (strlen(name) <= (size_t)longest)
+        return 1;
+    game_printf(g, "[!!] Names can be at most %d characters long.\n", longest);
+    game_printf(g, "%s", prompt);
+    return 0;
+}
+
+// Registers a new player with 100 credits. If another session registered
+// the same player first, that record is used.
+static void register_new_player(struct game *g, const char *name) {
+    struct store_record record;
+    int slot;
+
+    memset(&record, 0, sizeof(record));
+    record.uid = g->uid;
+    record.credits = record.highscore = 100;
+    snprintf(record.name, sizeof(record.name), "%s", name);
+
+    slot = store_insert(g->store, &record);
+    if (slot == -1 || (g->player = g->frontend->attach(g->context, g->uid, slot)) == NULL) {
+        game_printf(g, "[!!] Could not register you, try again later.\n");
+        g->state = GAME_OVER;
+        return;
+    }
+    game_printf(g, "\nWelcome to the Game of Chance, %s.\n", g->player->record.name);
+    game_printf(g, "You have been given %u credits.\n", g->player->record.credits);
+    show_menu(g);
+}
+
+// ============================ State Machine ===============================
+
+// Starts a session for uid: the menu if the player is registered, otherwise
+// registration
+void game_begin(struct game *g, struct store *store, int32_t uid,
+                const struct game_frontend *frontend, void *context) {
+    int slot;
+
+    memset(g, 0, sizeof(*g));
+    g->store = store;
+    g->uid = uid;
+    g->frontend = frontend;
+    g->context = context;
+
+    slot = store_find(store, uid);
+    if (slot == -1) {
+        game_printf(g, "-=-={ New Player Registration }=-=-\n");
+        game_printf(g, "Enter your name: ");
+        g->state = GAME_REGISTER_NAME;
+    } else if ((g->player = frontend->attach(context, uid, slot)) != NULL) {
+        show_menu(g);
+    } else {
+        g->state = GAME_OVER;
+    }
+}
+
+// Advances the game by one line of input, without its newline
+void game_input(struct game *g, const char *line) {
+    struct game_player *p = g->player;
+    int number = atoi(line);
+
+    switch (g->state) {
+    case GAME_REGISTER_NAME:
+        if (line[0] != '\0' && name_fits(g, line, "Enter your name: "))
+            register_new_player(g, line);
+        break;
+    case GAME_MENU:
+        if (number < 1 || number > 7) {
+            game_printf(g, "\n[!!] The number %d is an invalid selection.\n\n", number);
+            show_menu(g);
+        } else if (number < 4) { // Game choice
+            g->current_game = (number == 1) ? pick_a_number :
+                              (number == 2) ? dealer_no_match : find_the_ace;
+            play_the_game(g);
+        } else if (number == 4) {
+            show_highscore(g);
+        } else if (number == 5) {
+            game_printf(g, "\nChange user name\n");
+            game_printf(g, "Enter your new name: ");
+            g->state = GAME_RENAME;
+        } else if (number == 6) {
+            game_printf(g, "\nYour account has been reset with 100 credits.\n\n");
+            p->record.credits = 100;
+            player_changed(g);
+            show_menu(g);
+        } else {
+            game_printf(g, "\nThanks for playing! Bye.\n");
+            g->state = GAME_OVER;
+        }
+        break;
+    case GAME_RENAME:
+        if (line[0] == '\0' || !name_fits(g, line, "Enter your new name: "))
+            break;
+        snprintf(p->record.name, sizeof(p->record.name), "%s", line);
+        p->name_dirty = 1;
+        player_changed(g);
+        game_printf(g, "Your name has been changed.\n\n");
+        show_menu(g);
+        break;
+    case GAME_PICK_NUMBER:
+        pick_result(g, number);
+        break;
+    case GAME_DEALER_WAGER:
+        if (take_wager(g, number, 0) == -1)
+            ask_wager(g, GAME_DEALER_WAGER);
+        else
+            dealer_result(g, number);
+        break;
+    case GAME_ACE_WAGER:
+        if (take_wager(g, number, 0) == -1) {
+            ask_wager(g, GAME_ACE_WAGER);
+            break;
+        }
+        g->wager_one = number;
+        print_cards(g, "Dealing cards", "XXX", -1);
+        game_printf(g, "Select a card: 1, 2, or 3 ");
+        g->state = GAME_ACE_CARD;
+        break;
+    case GAME_ACE_CARD: {
+        char cards[3] = {'X', 'X', 'X'};
+        if (number < 1 || number > 3) {
+            game_printf(g, "Select a card: 1, 2, or 3 ");
+            break;
+        }
+        g->pick = number - 1; // Adjust pick since card numbering starts at 0.
+        g->revealed = reveal_queen(g->ace, g->pick); // Find a valid queen to reveal.
+        cards[g->revealed] = 'Q';
+        print_cards(g, "Revealing a queen", cards, g->pick);
+        ace_choice_prompt(g);
+        break;
+    }
+    case GAME_ACE_CHOICE:
+        if (line[0] == 'i') {
+            ask_wager(g, GAME_ACE_RAISE);
+        } else if (line[0] == 'c') {
+            g->pick = switch_pick(g->pick, g->revealed); // Find the other card
+            game_printf(g, "Your card pick has been changed to card %d\n", g->pick + 1);
+            ace_result(g);
+        } else {
+            ace_choice_prompt(g);
+        }
+        break;
+    case GAME_ACE_RAISE:
+        if (take_wager(g, number, g->wager_one) == -1) {
+            ask_wager(g, GAME_ACE_RAISE);
+            break;
+        }
+        g->wager_two = number;
+        ace_result(g);
+        break;
+    case GAME_PLAY_AGAIN:
+        if (line[0] == '\0')
+            break;
+        if (line[0] == 'n')
+            show_menu(g);
+        else
+            play_the_game(g);
+        break;
+    case GAME_SCORES_MORE:
+        if (line[0] == '\0')
+            break;
+        if (line[0] == 'y') {
+            show_scores_page(g);
+        } else {
+            game_printf(g, "======================================================\n\n");
+            show_menu(g);
+        }
+        break;
+    case GAME_OVER:
+        break;
+    }
+}
@@ -0,0 +1,80 @@
+#ifndef CHANCE_GAME_H
+#define CHANCE_GAME_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "chance_store.h"
+
+// The Game of Chance menu and games as a state machine driven one input line
+// at a time. The interactive program and the server both run it; they differ
+// only in where output goes and when a player's changes reach the store,
+// which they supply as a struct game_frontend.
+
+#define GAME_LINE_MAX 256           // Longest input line a front end passes in
+
+// A player as the games see them. The record's credits run ahead of the
+// store by whatever has not been synced yet, except that wagers are taken
+// from the store as they are made (see store_reserve()); a round abandoned
+// part way forfeits its wager.
+struct game_player {
+    struct store_record record;
+    int slot;
+    int32_t synced_credits;     // Credits as of the last sync with the store
+    int dirty;
+    int name_dirty;
+};
+
+struct game;
+
+// What a front end provides
+struct game_frontend {
+    // Sends output to the player
+    void (*write)(void *context, const char *text, size_t length);
+    // Returns the player held in the given slot, or NULL on failure
+    struct game_player *(*attach)(void *context, int32_t uid, int slot);
+    // The player changed: save now or batch it (see game_player_sync())
+    void (*changed)(void *context, struct game_player *player);
+    // Optional: saves pending changes before the leaderboard is read
+    void (*flush)(void *context);
+};
+
+// Where a game is in the menu and game flow; each state waits for one line
+enum game_state {
+    GAME_REGISTER_NAME,
+    GAME_MENU,
+    GAME_RENAME,
+    GAME_PICK_NUMBER,
+    GAME_DEALER_WAGER,
+    GAME_ACE_WAGER,
+    GAME_ACE_CARD,
+    GAME_ACE_CHOICE,
+    GAME_ACE_RAISE,
+    GAME_PLAY_AGAIN,
+    GAME_SCORES_MORE,
+    GAME_OVER
+};
+
+// One player's session
+struct game {
+    enum game_state state;
+    struct store *store;
+    const struct game_frontend *frontend;
+    void *context;              // Passed back to the front end
+    int32_t uid;
+    struct game_player *player; // NULL until registered
+    int debug;                  // Show the current_game pointer each round
+    // Current game
+    int (*current_game)(struct game *);
+    int winning_number;
+    int ace, pick, revealed, wager_one, wager_two;
+    // Leaderboard paging
+    struct store_board_entry top[STORE_BOARD_SIZE];
+    int top_count, page;
+};
+
+void game_begin(struct game *game, struct store *store, int32_t uid,
+                const struct game_frontend *frontend, void *context);
+void game_input(struct game *game, const char *line);
+void game_player_sync(struct store *store, struct game_player *player);
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef CHANCE_RULES_H
+#define CHANCE_RULES_H
+
+#include <stdint.h>
+
+// Rules shared by the interactive games, the server and the headless simulator
+
+#define PICK_COST 10            // Pick a Number: price of a round
+#define PICK_JACKPOT 100        // Pick a Number: prize for the winning number
+#define PICK_RANGE 20           // Pick a Number: numbers 1..PICK_RANGE
+#define DEALER_NUMBERS 16       // No Match Dealer: numbers dealt per round
+#define DEALER_RANGE 100        // No Match Dealer: numbers 0..DEALER_RANGE-1
+#define SCORES_PER_PAGE 10      // Leaderboard rows shown per page
+
+// Returns the first dealt number that repeats an earlier one, or -1 if all
+// are distinct. A 128-bit seen set replaces comparing every pair.
+static inline int first_match(const int *numbers, int count) {
+    uint64_t seen[2] = {0, 0};
+
+    for (int i = 0; i < count; i++) {
+        uint64_t bit = (uint64_t)1 << (numbers[i] & 63);
+        if (seen[numbers[i] >> 6] & bit)
+            return numbers[i];
+        seen[numbers[i] >> 6] |= bit;
+    }
+    return -1;
+}
+
+// Find the Ace: the queen shown to the player, never the ace or their pick
+static inline int reveal_queen(int ace, int pick) {
+    int i;
+    for (i = 0; i == ace || i == pick; i++); // First card that is neither
+    return i;
+}
+
+// Find the Ace: the card the player switches to after a queen is revealed
+static inline int switch_pick(int pick, int revealed) {
+    return 3 - pick - revealed;
+}
+
+#endif
@@ -0,0 +1,387 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "chance_store.h"
+#include "chance_game.h"
+#include "chance_server.h"
+
+#define SERVER_MAX_EVENTS 64
+#define SERVER_FLUSH_MS 1000        // How often dirty players are written back
+#define SERVER_OUT_MAX 16384        // Queued output at which a session's input waits
+
+// A connected player, shared by all of their sessions. The record is the
+// in-memory copy and runs ahead of the store until the next batch flush.
+struct server_player {
+    struct game_player game;    // First, so a game_player converts back
+    int sessions;
+    struct server_player *next;
+};
+
+// One client connection
+struct session {
+    int fd;
+    struct game game;
+    char in[GAME_LINE_MAX];
+    size_t in_len;
+    char *out;
+    size_t out_len, out_sent, out_cap;
+    int writing;                // Waiting for EPOLLOUT, with EPOLLIN off
+    int failed;                 // Output was lost; close the session
+};
+
+static struct store store;
+static struct server_player *players;
+static int epoll_fd;
+static volatile sig_atomic_t stopping;
+
+// ============================== Players ===================================
+
+// Writes every dirty player back to the store in one pass, then starts
+// writeback of the batch
+static void flush_players(void) {
+    int flushed = 0;
+
+    for (struct server_player *p = players; p != NULL; p = p->next) {
+        if (!p->game.dirty)
+            continue;
+        game_player_sync(&store, &p->game);
+        flushed++;
+    }
+    if (flushed)
+        store_sync(&store);
+}
+
+static struct server_player *attach_player(int32_t uid, int slot) {
+    struct server_player *p;
+
+    for (p = players; p != NULL; p = p->next) {
+        if (p->game.record.uid == uid) {
+            p->sessions++;
+            return p;
+        }
+    }
+    p = calloc(1, sizeof(*p));
+    if (p == NULL)
+        return NULL;
+    p->game.slot = slot;
+    store_apply(&store, slot, 0, NULL, &p->game.record); // Locked read of the record
+    p->game.synced_credits = p->game.record.credits;
+    p->sessions = 1;
+    p->next = players;
+    players = p;
+    return p;
+}
+
+// Drops a session's hold on its player, writing the player back when the
+// last session goes
+static void detach_player(struct server_player *player) {
+    struct server_player **link;
+
+    if (player == NULL || --player->sessions > 0)
+        return;
+    flush_players();
+    for (link = &players; *link != player; link = &(*link)->next)
+        ;
+    *link = player->next;
+    free(player);
+}
+
+// ============================== Front End =================================
+
+// Queues game output for the session's socket. Input stops being run once
+// SERVER_OUT_MAX bytes are queued, so the queue stays near that size.
+static void session_write(void *context, const char *text, size_t length) {
+    struct session *s = context;
+
+    if (s->failed)
+        return;
+    if (s->out_len + length > s->out_cap) {
+        size_t cap = s->out_cap ? s->out_cap : 1024;
+        char *bigger;
+        while (cap < s->out_len + length)
+            cap *= 2;
+        bigger = realloc(s->out, cap);
+        if (bigger == NULL) {
+            s->failed = 1; // The client would miss part of the game
+            return;
+        }
+        s->out = bigger;
+        s->out_cap = cap;
+    }
+    memcpy(s->out + s->out_len, text, length);
+    s->out_len += length;
+}
+
+static struct game_player *session_attach(void *context, int32_t uid, int slot) {
+    struct server_player *p = attach_player(uid, slot);
+    (void)context;
+    return p ? &p->game : NULL;
+}
+
+// Changes wait for the next batch flush
+static void session_changed(void *context, struct game_player *player) {
+    (void)context;
+    (void)player;
+}
+
+static void session_flush(void *context) {
+    (void)context;
+    flush_players();
+}
+
+static const struct game_frontend server_frontend = {
+    session_write, session_attach, session_changed, session_flush
+};
+
+// ============================== Sessions ==================================
+
+// Watches the session for input, or only for room to send while output is
+// queued, so a client that never reads can't make the server buffer more
+static void session_watch(struct session *s, int writing) {
+    struct epoll_event ev;
+
+    if (s->writing == writing)
+        return;
+    ev.events = writing ? EPOLLOUT : EPOLLIN;
+    ev.data.ptr = s;
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, s->fd, &ev);
+    s->writing = writing;
+}
+
+static void session_close(struct session *s) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, s->fd, NULL);
+    close(s->fd);
+    detach_player((struct server_player *)s->game.player);
+    free(s->out);
+    free(s);
+}
+
+// Runs each complete line of input through the state machine, holding the
+// rest back once SERVER_OUT_MAX bytes of output are queued
+static void run_lines(struct session *s) {
+    char *newline;
+
+    while (s->game.state != GAME_OVER && !s->failed && s->out_len < SERVER_OUT_MAX &&
+           (newline = memchr(s->in, '\n', s->in_len)) != NULL) {
+        size_t line_len = newline - s->in;
+        *newline = '\0';
+        if (line_len > 0 && s->in[line_len - 1] == '\r')
+            s->in[line_len - 1] = '\0';
+        game_input(&s->game, s->in);
+        memmove(s->in, newline + 1, s->in_len - line_len - 1);
+        s->in_len -= line_len + 1;
+    }
+}
+
+// Sends as much queued output as the socket takes, running input that was
+// held back as room frees up. Returns -1 once the session has been closed.
+static int session_send(struct session *s) {
+    do {
+        if (s->failed) {
+            session_close(s);
+            return -1;
+        }
+        while (s->out_sent < s->out_len) {
+            ssize_t sent = send(s->fd, s->out + s->out_sent, s->out_len - s->out_sent, MSG_NOSIGNAL);
+            if (sent == -1 && errno == EINTR)
+                continue;
+            if (sent == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                session_watch(s, 1);
+                return 0;
+            }
+            if (sent <= 0) {
+                session_close(s);
+                return -1;
+            }
+            s->out_sent += sent;
+        }
+        s->out_len = s->out_sent = 0;
+        if (s->game.state == GAME_OVER) {
+            session_close(s);
+            return -1;
+        }
+        run_lines(s);
+    } while (s->out_len > 0 || s->failed);
+    session_watch(s, 0);
+    return 0;
+}
+
+// ============================== Event Loop ================================
+
+static void accept_sessions(int listen_fd) {
+    for (;;) {
+        struct epoll_event ev;
+        struct ucred cred;
+        socklen_t cred_len = sizeof(cred);
+        struct session *s;
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+        if (fd == -1)
+            return; // EAGAIN: no more pending connections
+        s = calloc(1, sizeof(*s));
+        if (s == NULL || getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) == -1) {
+            free(s);
+            close(fd);
+            continue;
+        }
+        s->fd = fd;
+
+        ev.events = EPOLLIN;
+        ev.data.ptr = s;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+            free(s);
+            close(fd);
+            continue;
+        }
+
+        // The connecting user, as getuid() is for the setuid game
+        game_begin(&s->game, &store, cred.uid, &server_frontend, s);
+        session_send(s);
+    }
+}
+
+// Reads what the client sent and runs each complete line through the state
+// machine, until SERVER_OUT_MAX bytes of output wait to be sent
+static void read_session(struct session *s) {
+    while (s->game.state != GAME_OVER && s->out_len < SERVER_OUT_MAX && !s->failed) {
+        ssize_t got = read(s->fd, s->in + s->in_len, sizeof(s->in) - s->in_len);
+
+        if (got == -1 && errno == EINTR)
+            continue;
+        if (got == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (got <= 0) { // Disconnected
+            session_close(s);
+            return;
+        }
+        s->in_len += got;
+
+        run_lines(s);
+        if (s->in_len == sizeof(s->in) && memchr(s->in, '\n', s->in_len) == NULL) { // Line too long
+            session_close(s);
+            return;
+        }
+    }
+    session_send(s);
+}
+
+static long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
+
+// Clears the way for the server's socket. Only a socket that no server
+// answers on is removed; anything else at the path is left alone.
+static int remove_stale_socket(const struct sockaddr_un *addr) {
+    struct stat st;
+    int probe;
+
+    if (lstat(addr->sun_path, &st) == -1)
+        return (errno == ENOENT) ? 0 : -1;
+    if (!S_ISSOCK(st.st_mode)) {
+        fprintf(stderr, "[!!] %s exists and is not a socket\n", addr->sun_path);
+        return -1;
+    }
+    probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (probe != -1 && connect(probe, (const struct sockaddr *)addr, sizeof(*addr)) == 0) {
+        fprintf(stderr, "[!!] A server is already listening on %s\n", addr->sun_path);
+        close(probe);
+        return -1;
+    }
+    if (probe != -1)
+        close(probe);
+    return unlink(addr->sun_path);
+}
+
+static void stop_server(int signum) {
+    (void)signum;
+    stopping = 1;
+}
+
+// Serves sessions from one epoll loop. The store stays open and mapped for
+// the life of the server; dirty players are flushed every SERVER_FLUSH_MS,
+// when their last session leaves, and on shutdown.
+int run_server(const char *socket_path) {
+    struct sockaddr_un addr;
+    struct epoll_event ev, events[SERVER_MAX_EVENTS];
+    long next_flush;
+    int listen_fd, bound;
+    mode_t old_umask;
+
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "[!!] Socket path too long: %s\n", socket_path);
+        return 1;
+    }
+    if (store_open(&store, DATAFILE) == -1) {
+        perror("[!!] Fatal Error in run_server() while opening the player store");
+        return 1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socket_path);
+    if (remove_stale_socket(&addr) == -1)
+        return 1;
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    old_umask = umask(0111); // Create the socket rw for everyone, with no chmod() by path
+    bound = listen_fd != -1 && bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+    umask(old_umask);
+    if (!bound || listen(listen_fd, SOMAXCONN) == -1) {
+        perror("[!!] Fatal Error in run_server() while creating the socket");
+        return 1;
+    }
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL; // The listening socket
+    if (epoll_fd == -1 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev) == -1) {
+        perror("[!!] Fatal Error in run_server() while setting up epoll");
+        return 1;
+    }
+
+    signal(SIGINT, stop_server);
+    signal(SIGTERM, stop_server);
+    signal(SIGPIPE, SIG_IGN);
+    srand(time(0));
+    printf("Game of Chance server listening on %s\n", socket_path);
+
+    next_flush = now_ms() + SERVER_FLUSH_MS;
+    while (!stopping) {
+        long wait = next_flush - now_ms();
+        int ready = epoll_wait(epoll_fd, events, SERVER_MAX_EVENTS, wait > 0 ? (int)wait : 0);
+
+        for (int i = 0; i < ready; i++) {
+            struct session *s = events[i].data.ptr;
+            if (s == NULL)
+                accept_sessions(listen_fd);
+            else if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+                read_session(s); // Also sends any reply
+            else if (events[i].events & EPOLLOUT)
+                session_send(s);
+        }
+        if (now_ms() >= next_flush) {
+            flush_players();
+            next_flush = now_ms() + SERVER_FLUSH_MS;
+        }
+    }
+
+    flush_players();
+    close(listen_fd);
+    unlink(socket_path);
+    store_close(&store);
+    printf("\nGame of Chance server stopped.\n");
+    return 0;
+}
@@ -0,0 +1,9 @@
+#ifndef CHANCE_SERVER_H
+#define CHANCE_SERVER_H
+
+#define SERVER_SOCKET "/run/chance.sock"  // Default Unix socket for --server, in a root-only directory
+
+// Serves Game of Chance sessions over a Unix domain socket until SIGINT/SIGTERM
+int run_server(const char *socket_path);
+
+#endif
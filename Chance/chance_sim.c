@@ -0,0 +1,316 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "chance_rules.h"
+#include "chance_sim.h"
+
+#define SIM_DEFAULT_ROUNDS 100000000ULL
+#define SIM_MAX_THREADS 256
+#define SIM_WAGER 10            // Credits wagered per round where the game asks
+
+// ============================ Random Numbers ==============================
+
+// xoshiro256** generator; each thread owns one, so there is no shared state
+struct sim_rng {
+    uint64_t s[4];
+};
+
+static inline uint64_t rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+static inline uint64_t rng_next(struct sim_rng *rng) {
+    uint64_t *s = rng->s;
+    uint64_t result = rotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+    return result;
+}
+
+// Uniform integer in [0, n) by multiply-shift with Lemire's rejection step.
+// Plain multiply-shift is biased by up to n / 2^32 (2^-25.4 for the dealer's
+// 100 numbers); rejecting the few low products that cause it makes every
+// value exactly equally likely, and the check almost never loops.
+static inline int rng_below(struct sim_rng *rng, uint32_t n) {
+    uint64_t m = (rng_next(rng) >> 32) * n;
+
+    if ((uint32_t)m < n) {
+        uint32_t threshold = -n % n; // 2^32 mod n
+        while ((uint32_t)m < threshold)
+            m = (rng_next(rng) >> 32) * n;
+    }
+    return (int)(m >> 32);
+}
+
+static uint64_t splitmix64(uint64_t *x) {
+    uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// Advances the generator by 2^128 steps, giving each thread a stream that
+// cannot overlap any other thread's
+static void rng_jump(struct sim_rng *rng) {
+    static const uint64_t jump[] = { 0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL,
+                                     0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL };
+    uint64_t s[4] = {0, 0, 0, 0};
+
+    for (int i = 0; i < 4; i++) {
+        for (int b = 0; b < 64; b++) {
+            if (jump[i] & ((uint64_t)1 << b)) {
+                for (int k = 0; k < 4; k++)
+                    s[k] ^= rng->s[k];
+            }
+            rng_next(rng);
+        }
+    }
+    memcpy(rng->s, s, sizeof(s));
+}
+
+// ============================== Strategies ================================
+
+// Decisions a game asks of the player
+enum decision {
+    DECIDE_NUMBER,      // Pick a Number: number to pick, 1..PICK_RANGE
+    DECIDE_CARD,        // Find the Ace: first card, 0..2
+    DECIDE_SWITCH,      // Find the Ace: 1 to change pick, 0 to increase the wager
+    DECIDE_RAISE        // Find the Ace: credits added when increasing the wager
+};
+
+// A pluggable player strategy
+struct strategy {
+    const char *game;
+    const char *name;
+    const char *description;
+    int (*decide)(struct sim_rng *rng, enum decision decision);
+};
+
+static int fixed_number(struct sim_rng *rng, enum decision decision) {
+    (void)rng;
+    (void)decision;
+    return 7;
+}
+
+static int random_number(struct sim_rng *rng, enum decision decision) {
+    (void)decision;
+    return rng_below(rng, PICK_RANGE) + 1;
+}
+
+static int flat_wager(struct sim_rng *rng, enum decision decision) {
+    (void)rng;
+    (void)decision;
+    return 0;
+}
+
+static int always_switch(struct sim_rng *rng, enum decision decision) {
+    return decision == DECIDE_CARD ? rng_below(rng, 3) : 1;
+}
+
+static int never_switch(struct sim_rng *rng, enum decision decision) {
+    if (decision == DECIDE_CARD)
+        return rng_below(rng, 3);
+    return decision == DECIDE_RAISE ? 1 : 0; // Raise by the minimum the game allows
+}
+
+static int double_down(struct sim_rng *rng, enum decision decision) {
+    if (decision == DECIDE_CARD)
+        return rng_below(rng, 3);
+    return decision == DECIDE_RAISE ? SIM_WAGER : 0;
+}
+
+static int coin_flip(struct sim_rng *rng, enum decision decision) {
+    if (decision == DECIDE_CARD)
+        return rng_below(rng, 3);
+    return decision == DECIDE_RAISE ? 1 : rng_below(rng, 2);
+}
+
+static const struct strategy strategies[] = {
+    { "pick",   "fixed",  "always pick 7",                            fixed_number },
+    { "pick",   "random", "pick a random number",                     random_number },
+    { "dealer", "flat",   "wager 10 credits every round",             flat_wager },
+    { "ace",    "switch", "always change pick after the reveal",      always_switch },
+    { "ace",    "stay",   "never switch, raise the wager by 1",       never_switch },
+    { "ace",    "double", "never switch, double the wager",           double_down },
+    { "ace",    "random", "switch or stay on a coin flip",            coin_flip },
+};
+
+#define STRATEGY_COUNT (int)(sizeof(strategies) / sizeof(strategies[0]))
+
+// ================================ Games ===================================
+
+// Each round function returns the player's net credits and sets the stake
+
+static int round_pick(struct sim_rng *rng, const struct strategy *strategy, int *stake) {
+    int winning_number = rng_below(rng, PICK_RANGE) + 1;
+
+    *stake = PICK_COST;
+    return (strategy->decide(rng, DECIDE_NUMBER) == winning_number) ? PICK_JACKPOT - PICK_COST : -PICK_COST;
+}
+
+static int round_dealer(struct sim_rng *rng, const struct strategy *strategy, int *stake) {
+    int numbers[DEALER_NUMBERS];
+
+    (void)strategy;
+    for (int i = 0; i < DEALER_NUMBERS; i++)
+        numbers[i] = rng_below(rng, DEALER_RANGE);
+    *stake = SIM_WAGER;
+    return (first_match(numbers, DEALER_NUMBERS) == -1) ? SIM_WAGER : -SIM_WAGER;
+}
+
+static int round_ace(struct sim_rng *rng, const struct strategy *strategy, int *stake) {
+    int ace = rng_below(rng, 3);
+    int pick = strategy->decide(rng, DECIDE_CARD);
+    int revealed = reveal_queen(ace, pick);
+
+    *stake = SIM_WAGER;
+    if (strategy->decide(rng, DECIDE_SWITCH))
+        pick = switch_pick(pick, revealed);
+    else
+        *stake += strategy->decide(rng, DECIDE_RAISE);
+    return (pick == ace) ? *stake : -*stake;
+}
+
+// ============================== Simulation ================================
+
+// Per-thread work and tallies
+struct sim_job {
+    const struct strategy *strategy;
+    int (*round)(struct sim_rng *, const struct strategy *, int *);
+    struct sim_rng rng;
+    uint64_t rounds;
+    int64_t net_sum;
+    uint64_t net_squares;
+    uint64_t stake_sum;
+    uint64_t wins;
+};
+
+static void *sim_worker(void *arg) {
+    struct sim_job *job = arg;
+    struct sim_rng rng = job->rng;
+    int64_t net_sum = 0;
+    uint64_t net_squares = 0, stake_sum = 0, wins = 0;
+    int stake;
+
+    for (uint64_t i = 0; i < job->rounds; i++) {
+        int net = job->round(&rng, job->strategy, &stake);
+        net_sum += net;
+        net_squares += (uint64_t)((int64_t)net * net);
+        stake_sum += stake;
+        wins += (net > 0);
+    }
+
+    job->net_sum = net_sum;
+    job->net_squares = net_squares;
+    job->stake_sum = stake_sum;
+    job->wins = wins;
+    return NULL;
+}
+
+static void sim_usage(void) {
+    fprintf(stderr, "Usage: game_of_chance --simulate <pick|dealer|ace> [strategy] [rounds] [threads]\n");
+    fprintf(stderr, "Strategies:\n");
+    for (int i = 0; i < STRATEGY_COUNT; i++)
+        fprintf(stderr, "  %-7s %-7s %s\n", strategies[i].game, strategies[i].name, strategies[i].description);
+}
+
+// Runs the requested number of rounds across all cores and reports the
+// player's mean result with a 95% confidence interval and the house edge
+int simulate(int argc, char *argv[]) {
+    static struct sim_job jobs[SIM_MAX_THREADS];
+    pthread_t threads[SIM_MAX_THREADS];
+    const struct strategy *strategy = NULL;
+    int (*round)(struct sim_rng *, const struct strategy *, int *);
+    uint64_t rounds = SIM_DEFAULT_ROUNDS, seed, net_squares = 0, stake_sum = 0, wins = 0;
+    int64_t net_sum = 0;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int thread_count = (cpus < 1) ? 1 : (int)cpus;
+    int next = 1;
+    struct sim_rng rng;
+    struct timespec start, end;
+    double seconds, mean, variance, ci, mean_stake;
+
+    if (argc < 1) {
+        sim_usage();
+        return 1;
+    }
+    if (argc > 1 && !isdigit((unsigned char)argv[1][0]))
+        next = 2; // A strategy was named; otherwise use the game's first one
+    for (int i = 0; i < STRATEGY_COUNT; i++) {
+        if (strcmp(strategies[i].game, argv[0]) == 0 &&
+            (next == 1 || strcmp(strategies[i].name, argv[1]) == 0)) {
+            strategy = &strategies[i];
+            break;
+        }
+    }
+    if (strategy == NULL) {
+        sim_usage();
+        return 1;
+    }
+    round = (strcmp(argv[0], "pick") == 0) ? round_pick :
+            (strcmp(argv[0], "dealer") == 0) ? round_dealer : round_ace;
+    if (argc > next)
+        rounds = (uint64_t)strtod(argv[next], NULL); // Accepts 1e9 as well as 1000000000
+    if (argc > next + 1)
+        thread_count = atoi(argv[next + 1]);
+    if (rounds < 1 || thread_count < 1) {
+        sim_usage();
+        return 1;
+    }
+    if (thread_count > SIM_MAX_THREADS)
+        thread_count = SIM_MAX_THREADS;
+
+    seed = (uint64_t)time(NULL) ^ ((uint64_t)getpid() << 32);
+    for (int k = 0; k < 4; k++)
+        rng.s[k] = splitmix64(&seed);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int t = 0; t < thread_count; t++) {
+        jobs[t].strategy = strategy;
+        jobs[t].round = round;
+        jobs[t].rng = rng;
+        jobs[t].rounds = rounds / thread_count + ((uint64_t)t < rounds % thread_count);
+        rng_jump(&rng);
+        if (pthread_create(&threads[t], NULL, sim_worker, &jobs[t]) != 0) {
+            fprintf(stderr, "Error: could not start simulation thread %d.\n", t);
+            return 1;
+        }
+    }
+    for (int t = 0; t < thread_count; t++) {
+        pthread_join(threads[t], NULL);
+        net_sum += jobs[t].net_sum;
+        net_squares += jobs[t].net_squares;
+        stake_sum += jobs[t].stake_sum;
+        wins += jobs[t].wins;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    mean = (double)net_sum / rounds;
+    variance = (rounds > 1) ? ((double)net_squares - mean * (double)net_sum) / (rounds - 1) : 0.0;
+    ci = 1.96 * sqrt(variance > 0 ? variance / rounds : 0.0);
+    mean_stake = (double)stake_sum / rounds;
+
+    printf("-=[ Game of Chance Simulation ]=-\n");
+    printf("Game: %s, strategy: %s (%s)\n", strategy->game, strategy->name, strategy->description);
+    printf("Rounds: %llu on %d threads in %.3f seconds (%.0f rounds/sec)\n",
+           (unsigned long long)rounds, thread_count, seconds, rounds / seconds);
+    printf("Player wins: %.4f%% of rounds\n", 100.0 * wins / rounds);
+    printf("Mean stake: %.4f credits per round\n", mean_stake);
+    printf("Mean result: %+.4f credits per round (95%% CI %+.4f to %+.4f)\n", mean, mean - ci, mean + ci);
+    printf("House edge: %.4f%% of stake (95%% CI %.4f%% to %.4f%%)\n",
+           -100.0 * mean / mean_stake, -100.0 * (mean + ci) / mean_stake, -100.0 * (mean - ci) / mean_stake);
+    return 0;
+}
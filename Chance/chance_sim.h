@@ -0,0 +1,8 @@
+#ifndef CHANCE_SIM_H
+#define CHANCE_SIM_H
+
+// Headless Monte Carlo simulation of the Game of Chance games.
+// argv holds: <pick|dealer|ace> [strategy] [rounds] [threads]
+int simulate(int argc, char *argv[]);
+
+#endif
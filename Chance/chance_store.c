@@ -0,0 +1,796 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "chance_store.h"
+
+// Record layout of the original flat /var/chance.data file
+struct legacy_user {
+    int uid;
+    int credits;
+    int highscore;
+    char name[100];
+    int (*current_game)();
+};
+
+// Slot layout of store versions 1 and 2: the raw in-memory struct
+struct raw_record {
+    int32_t uid;
+    int32_t credits;
+    int32_t highscore;
+    char name[STORE_NAME_LEN];
+};
+
+_Static_assert(sizeof(struct store_header) <= STORE_HEADER_SIZE, "store header overflows its page");
+_Static_assert(STORE_SLOT_SIZE >= REC_NAME + STORE_NAME_LEN - 1, "new slots must hold the longest name");
+
+// Byte size of a store file with the given geometry
+static size_t store_file_size(uint32_t capacity, uint32_t slot_size, uint32_t buckets) {
+    return STORE_HEADER_SIZE + (size_t)capacity * slot_size + (size_t)buckets * sizeof(uint32_t);
+}
+
+// Checks a current-format header before its geometry is trusted: the slots
+// must hold a record, the index must be a power of two with a free bucket
+// for probes to stop at, the file must be long enough to map, and the
+// leaderboard may only name slots in use
+static int header_valid(const struct store_header *hdr, off_t size) {
+    if (hdr->slot_size <= REC_NAME || hdr->slot_size > STORE_MAX_SLOT_SIZE ||
+        hdr->count > hdr->capacity || hdr->buckets <= hdr->capacity ||
+        (hdr->buckets & (hdr->buckets - 1)) != 0 ||
+        (size_t)size < store_file_size(hdr->capacity, hdr->slot_size, hdr->buckets) ||
+        hdr->board.count > STORE_BOARD_SIZE)
+        return 0;
+    for (uint32_t i = 0; i < hdr->board.count; i++) {
+        if (hdr->board.heap[i].slot >= hdr->count)
+            return 0;
+    }
+    return 1;
+}
+
+static uint32_t uid_hash(int32_t uid) {
+    return (uint32_t)uid * 2654435761u;
+}
+
+// Points hdr/index into the current mapping
+static void store_bind(struct store *store) {
+    store->hdr = (struct store_header *)store->map;
+    store->index = (uint32_t *)(store->map + STORE_HEADER_SIZE +
+                                (size_t)store->hdr->capacity * store->hdr->slot_size);
+}
+
+// (Re)maps the file at its current header geometry
+static int store_map(struct store *store) {
+    struct store_header hdr;
+    size_t size;
+
+    if (pread(store->fd, &hdr, sizeof(hdr), 0) != sizeof(hdr))
+        return -1;
+    size = store_file_size(hdr.capacity, hdr.slot_size, hdr.buckets);
+
+    if (store->map != NULL)
+        munmap(store->map, store->map_size);
+    store->map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, store->fd, 0);
+    if (store->map == MAP_FAILED) {
+        store->map = NULL;
+        return -1;
+    }
+    store->map_size = size;
+    store_bind(store);
+    return 0;
+}
+
+// Waits until the mapped bytes [start, start + length) are on disk. Used
+// before clearing a dirty flag: the header page can reach the disk at any
+// time, and after an OS crash it must not show the flag clear over an index
+// or slot that never got there.
+static void store_persist(struct store *store, const void *start, size_t length) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t offset = (const char *)start - store->map;
+    size_t first = offset / page * page;
+
+    msync(store->map + first, offset + length - first, MS_SYNC);
+}
+
+// Another process may have grown the file since we mapped it
+static int store_remap_if_grown(struct store *store) {
+    if (store_file_size(store->hdr->capacity, store->hdr->slot_size, store->hdr->buckets) == store->map_size)
+        return 0;
+    return store_map(store);
+}
+
+static unsigned char *store_slot(struct store *store, int slot) {
+    return (unsigned char *)store->map + STORE_HEADER_SIZE + (size_t)slot * store->hdr->slot_size;
+}
+
+// =============================== Records ==================================
+
+static int32_t get_i32(const unsigned char *p) {
+    return (int32_t)((uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+}
+
+static void put_i32(unsigned char *p, int32_t value) {
+    uint32_t v = (uint32_t)value;
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+// Packs a record into a slot of slot_size bytes, cutting the name to fit
+static void record_encode(unsigned char *slot, uint32_t slot_size, const struct store_record *record) {
+    size_t name_len = strnlen(record->name, STORE_NAME_LEN - 1);
+
+    if (name_len > slot_size - REC_NAME)
+        name_len = slot_size - REC_NAME;
+    put_i32(slot + REC_UID, record->uid);
+    put_i32(slot + REC_CREDITS, record->credits);
+    put_i32(slot + REC_HIGHSCORE, record->highscore);
+    slot[REC_NAME_LEN] = (unsigned char)name_len;
+    memcpy(slot + REC_NAME, record->name, name_len);
+    memset(slot + REC_NAME + name_len, 0, slot_size - REC_NAME - name_len);
+}
+
+static void record_decode(const unsigned char *slot, uint32_t slot_size, struct store_record *record) {
+    size_t name_len = slot[REC_NAME_LEN];
+
+    if (name_len > slot_size - REC_NAME)
+        name_len = slot_size - REC_NAME; // Damaged slot; never read past it
+    if (name_len > STORE_NAME_LEN - 1)
+        name_len = STORE_NAME_LEN - 1;   // Nor write past the name buffer
+    memset(record, 0, sizeof(*record));
+    record->uid = get_i32(slot + REC_UID);
+    record->credits = get_i32(slot + REC_CREDITS);
+    record->highscore = get_i32(slot + REC_HIGHSCORE);
+    memcpy(record->name, slot + REC_NAME, name_len);
+}
+
+// Reads a player record without locking it, for display
+void store_get(struct store *store, int slot, struct store_record *record) {
+    record_decode(store_slot(store, slot), store->hdr->slot_size, record);
+}
+
+// Longest name, in bytes, that the store's slots hold without cutting it
+int store_name_max(struct store *store) {
+    uint32_t room = store->hdr->slot_size - REC_NAME;
+    return room < STORE_NAME_LEN - 1 ? (int)room : STORE_NAME_LEN - 1;
+}
+
+// Smallest slot size, rounded up to STORE_SLOT_ALIGN and at least minimum,
+// that holds every name in records without cutting it
+uint32_t store_fit_slot_size(const struct store_record *records, size_t count, uint32_t minimum) {
+    size_t longest = 0;
+    uint32_t size;
+
+    for (size_t i = 0; i < count; i++) {
+        size_t len = strnlen(records[i].name, STORE_NAME_LEN - 1);
+        if (len > longest)
+            longest = len;
+    }
+    size = REC_NAME + longest;
+    if (size < minimum)
+        size = minimum;
+    return (size + STORE_SLOT_ALIGN - 1) / STORE_SLOT_ALIGN * STORE_SLOT_ALIGN;
+}
+
+// ================================ Locking =================================
+
+// Takes (F_RDLCK/F_WRLCK) or releases (F_UNLCK) an fcntl() lock on a byte
+// range of the store, waiting for conflicting locks held by other sessions.
+// The kernel drops a session's locks if it dies, so a lock that can be taken
+// is never held by a half-finished update.
+static void store_lock(struct store *store, short type, off_t start, off_t length) {
+    struct flock fl;
+
+    memset(&fl, 0, sizeof(fl));
+    fl.l_type = type;
+    fl.l_whence = SEEK_SET;
+    fl.l_start = start;
+    fl.l_len = length;
+    while (fcntl(store->fd, F_SETLKW, &fl) == -1 && errno == EINTR)
+        ;
+}
+
+// Like store_lock() but fails with EBUSY instead of waiting
+static int store_trylock(struct store *store, short type, off_t start, off_t length) {
+    struct flock fl;
+
+    memset(&fl, 0, sizeof(fl));
+    fl.l_type = type;
+    fl.l_whence = SEEK_SET;
+    fl.l_start = start;
+    fl.l_len = length;
+    if (fcntl(store->fd, F_SETLK, &fl) == -1) {
+        if (errno == EAGAIN || errno == EACCES)
+            errno = EBUSY;
+        return -1;
+    }
+    return 0;
+}
+
+// Guards the file geometry, slot count and index
+static void lock_geometry(struct store *store, short type) {
+    store_lock(store, type, STORE_LOCK_GEOMETRY, 1);
+}
+
+// Guards the leaderboard
+static void lock_board(struct store *store, short type) {
+    store_lock(store, type, STORE_LOCK_BOARD, 1);
+}
+
+// Guards a single player slot
+static void lock_record(struct store *store, int slot, short type) {
+    store_lock(store, type, STORE_HEADER_SIZE + (off_t)slot * store->hdr->slot_size, store->hdr->slot_size);
+}
+
+// The dirty flags share a word but are guarded by different locks
+static void flag_set(struct store *store, uint32_t flag) {
+    __atomic_or_fetch(&store->hdr->flags, flag, __ATOMIC_SEQ_CST);
+}
+
+static void flag_clear(struct store *store, uint32_t flag) {
+    __atomic_and_fetch(&store->hdr->flags, ~flag, __ATOMIC_SEQ_CST);
+}
+
+// =============================== Index ====================================
+
+// Returns the bucket used
+static uint32_t index_put(struct store *store, int32_t uid, uint32_t slot) {
+    uint32_t mask = store->hdr->buckets - 1;
+    uint32_t b = uid_hash(uid) & mask;
+
+    while (store->index[b] != 0)
+        b = (b + 1) & mask;
+    store->index[b] = slot + 1;
+    return b;
+}
+
+// Probes the index for uid; the geometry lock must be held
+static int index_find(struct store *store, int32_t uid) {
+    uint32_t mask = store->hdr->buckets - 1, b, entry;
+
+    for (b = uid_hash(uid) & mask; (entry = store->index[b]) != 0; b = (b + 1) & mask) {
+        if (entry - 1 < store->hdr->count && get_i32(store_slot(store, entry - 1) + REC_UID) == uid)
+            return entry - 1;
+    }
+    return -1;
+}
+
+// Rebuilds the uid index from the slots, which are the source of truth
+static void index_rebuild(struct store *store) {
+    memset(store->index, 0, (size_t)store->hdr->buckets * sizeof(uint32_t));
+    for (uint32_t i = 0; i < store->hdr->count; i++)
+        index_put(store, get_i32(store_slot(store, i) + REC_UID), i);
+    store_persist(store, store->index, (size_t)store->hdr->buckets * sizeof(uint32_t));
+}
+
+// ============================== Leaderboard ===============================
+
+static uint32_t board_home(int32_t uid) {
+    return (uid_hash(uid) >> 24) & (STORE_BOARD_BUCKETS - 1);
+}
+
+// Finds uid's bucket in the position table; the bucket is empty if absent
+static uint32_t board_bucket(struct store_board *board, int32_t uid) {
+    uint32_t b = board_home(uid);
+
+    while (board->where[b].pos != 0 && board->where[b].uid != uid)
+        b = (b + 1) & (STORE_BOARD_BUCKETS - 1);
+    return b;
+}
+
+// Removes uid from the position table, shifting later entries of its probe
+// run back so lookups never need tombstones
+static void board_forget(struct store_board *board, int32_t uid) {
+    uint32_t mask = STORE_BOARD_BUCKETS - 1;
+    uint32_t hole = board_bucket(board, uid), b = hole;
+
+    if (board->where[hole].pos == 0)
+        return;
+    board->where[hole].pos = 0;
+    for (b = (b + 1) & mask; board->where[b].pos != 0; b = (b + 1) & mask) {
+        uint32_t home = board_home(board->where[b].uid);
+        // Move the entry into the hole unless its home lies cyclically in (hole, b]
+        if (((b - home) & mask) >= ((b - hole) & mask)) {
+            board->where[hole] = board->where[b];
+            board->where[b].pos = 0;
+            hole = b;
+        }
+    }
+}
+
+// Places an entry at heap position pos and records where it went
+static void board_place(struct store_board *board, uint32_t pos, struct store_board_entry entry) {
+    uint32_t b = board_bucket(board, entry.uid);
+
+    board->heap[pos] = entry;
+    board->where[b].uid = entry.uid;
+    board->where[b].pos = pos + 1;
+}
+
+static void board_sift_up(struct store_board *board, uint32_t pos) {
+    struct store_board_entry entry = board->heap[pos];
+
+    while (pos > 0 && board->heap[(pos - 1) / 2].score > entry.score) {
+        board_place(board, pos, board->heap[(pos - 1) / 2]);
+        pos = (pos - 1) / 2;
+    }
+    board_place(board, pos, entry);
+}
+
+static void board_sift_down(struct store_board *board, uint32_t pos) {
+    struct store_board_entry entry = board->heap[pos];
+
+    for (;;) {
+        uint32_t child = pos * 2 + 1;
+        if (child >= board->count)
+            break;
+        if (child + 1 < board->count && board->heap[child + 1].score < board->heap[child].score)
+            child++;
+        if (board->heap[child].score >= entry.score)
+            break;
+        board_place(board, pos, board->heap[child]);
+        pos = child;
+    }
+    board_place(board, pos, entry);
+}
+
+// Offers a player's high score to the leaderboard
+static void board_offer(struct store_board *board, int32_t uid, uint32_t slot, int32_t score) {
+    struct store_board_entry entry = { uid, slot, score };
+    uint32_t b = board_bucket(board, uid);
+
+    if (board->where[b].pos != 0) {         // Already on the board
+        uint32_t pos = board->where[b].pos - 1;
+        if (score > board->heap[pos].score) {
+            board->heap[pos].score = score;
+            board_sift_down(board, pos);
+        }
+    } else if (board->count < STORE_BOARD_SIZE) {
+        board->heap[board->count] = entry;
+        board->count++;
+        board_sift_up(board, board->count - 1);
+    } else if (score > board->heap[0].score) { // Knock out the lowest score
+        board_forget(board, board->heap[0].uid);
+        board->heap[0] = entry;
+        board_sift_down(board, 0);
+    }
+}
+
+// Rebuilds the leaderboard from the slots
+static void board_rebuild(struct store *store) {
+    struct store_board *board = &store->hdr->board;
+
+    memset(board, 0, sizeof(*board));
+    for (uint32_t i = 0; i < store->hdr->count; i++) {
+        unsigned char *slot = store_slot(store, i);
+        board_offer(board, get_i32(slot + REC_UID), i, get_i32(slot + REC_HIGHSCORE));
+    }
+}
+
+// Brackets a change to a high score and the leaderboard. The dirty flag is
+// up for the whole change so that a session dying part way through is
+// repaired on open.
+static void board_begin(struct store *store) {
+    lock_board(store, F_WRLCK);
+    flag_set(store, STORE_BOARD_DIRTY);
+}
+
+static void board_end(struct store *store) {
+    flag_clear(store, STORE_BOARD_DIRTY);
+    lock_board(store, F_UNLCK);
+}
+
+static int board_compare(const void *a, const void *b) {
+    const struct store_board_entry *x = a, *y = b;
+    return (y->score > x->score) - (y->score < x->score);
+}
+
+// Copies up to max leaderboard entries into top, best score first.
+// Returns the number copied. Costs O(K log K), independent of player count,
+// and remaps first, so every returned slot can be read with store_get().
+int store_top(struct store *store, struct store_board_entry *top, int max) {
+    struct store_board_entry sorted[STORE_BOARD_SIZE];
+    int count;
+
+    lock_geometry(store, F_RDLCK);
+    store_remap_if_grown(store);
+    lock_board(store, F_RDLCK);
+    count = store->hdr->board.count;
+    memcpy(sorted, store->hdr->board.heap, count * sizeof(sorted[0]));
+    lock_board(store, F_UNLCK);
+    lock_geometry(store, F_UNLCK);
+
+    qsort(sorted, count, sizeof(sorted[0]), board_compare);
+    if (count > max)
+        count = max;
+    memcpy(top, sorted, count * sizeof(sorted[0]));
+    return count;
+}
+
+// ================================ Store ===================================
+
+// Writes a fresh, empty store file
+static int store_format(int fd, uint32_t capacity, uint32_t slot_size) {
+    struct store_header hdr = {0};
+
+    hdr.magic = STORE_MAGIC;
+    hdr.version = STORE_VERSION;
+    hdr.slot_size = slot_size;
+    hdr.capacity = capacity;
+    hdr.buckets = capacity * 2;
+    if (ftruncate(fd, store_file_size(hdr.capacity, hdr.slot_size, hdr.buckets)) == -1)
+        return -1;
+    if (pwrite(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr))
+        return -1;
+    return 0;
+}
+
+// Reads every record of an open file in any format this code has written:
+// a flat file of struct legacy_user, a version 1/2 store of raw structs, or
+// the current packed format. The caller frees *records. Unlike store_load(),
+// this keeps the caller's fcntl() locks: closing any descriptor of a file
+// drops all of the process's locks on it.
+int store_load_fd(int fd, struct store_record **records, size_t *count) {
+    struct store_header hdr = {0};
+    struct stat st;
+    size_t n, record_size, offset;
+    uint32_t slot_size = 0;
+    unsigned char buffer[sizeof(struct legacy_user) > STORE_MAX_SLOT_SIZE ?
+                         sizeof(struct legacy_user) : STORE_MAX_SLOT_SIZE];
+
+    if (fstat(fd, &st) == -1)
+        return -1;
+    if (st.st_size >= (off_t)sizeof(hdr) && pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr))
+        return -1;
+
+    if (hdr.magic != STORE_MAGIC) {             // Flat legacy file
+        record_size = sizeof(struct legacy_user);
+        offset = 0;
+        n = st.st_size / record_size;
+        if (st.st_size % record_size != 0) { // Not one: a damaged store, or some other file
+            errno = EINVAL;
+            return -1;
+        }
+    } else {
+        record_size = slot_size = hdr.slot_size;
+        offset = STORE_HEADER_SIZE;
+        n = hdr.count;
+        if (hdr.version > STORE_VERSION) { // Written by a newer version of this code
+            errno = ENOTSUP;
+            return -1;
+        }
+        if ((hdr.version >= 3 && !header_valid(&hdr, st.st_size)) ||
+            (hdr.version < 3 && slot_size != sizeof(struct raw_record))) {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+
+    *records = calloc(n ? n : 1, sizeof(struct store_record));
+    if (*records == NULL)
+        return -1;
+    for (size_t i = 0; i < n; i++) {
+        struct store_record *r = &(*records)[i];
+        if (pread(fd, buffer, record_size, offset + i * record_size) != (ssize_t)record_size) {
+            free(*records);
+            errno = EIO;
+            return -1;
+        }
+        if (hdr.magic != STORE_MAGIC || hdr.version < 3) {
+            // Both older layouts start with the same three ints and name
+            struct raw_record raw;
+            memcpy(&raw, buffer, sizeof(raw));
+            if (memchr(raw.name, '\0', sizeof(raw.name)) == NULL) { // Names were always terminated
+                free(*records);
+                errno = EINVAL;
+                return -1;
+            }
+            r->uid = raw.uid;
+            r->credits = raw.credits;
+            r->highscore = raw.highscore;
+            memcpy(r->name, raw.name, STORE_NAME_LEN - 1);
+        } else {
+            record_decode(buffer, slot_size, r);
+        }
+    }
+    *count = n;
+    return 0;
+}
+
+// Reads every record of the store file at path, in any supported format
+int store_load(const char *path, struct store_record **records, size_t *count) {
+    int fd = open(path, O_RDONLY), result;
+
+    if (fd == -1)
+        return -1;
+    result = store_load_fd(fd, records, count);
+    close(fd);
+    return result;
+}
+
+// Writes records to a new, tightly sized store in the current format and
+// renames it over path. Later duplicates of a uid are dropped, as lookups in
+// older files only ever found the first. Returns the number of players
+// written, or -1 on failure.
+int store_save(const char *path, const struct store_record *records, size_t count, uint32_t slot_size) {
+    char tmp_path[4096];
+    struct store store = {0};
+    uint32_t capacity = STORE_INITIAL_SLOTS;
+    int fd;
+
+    while (capacity < count)
+        capacity *= 2;
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s.convert", path);
+    fd = open(tmp_path, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (fd == -1)
+        return -1;
+    store.fd = fd;
+    if (store_format(fd, capacity, slot_size) == -1 || store_map(&store) == -1) {
+        close(fd);
+        unlink(tmp_path);
+        return -1;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (index_find(&store, records[i].uid) != -1)
+            continue;
+        record_encode(store_slot(&store, store.hdr->count), slot_size, &records[i]);
+        index_put(&store, records[i].uid, store.hdr->count);
+        store.hdr->count++;
+    }
+    board_rebuild(&store);
+
+    if (msync(store.map, store.map_size, MS_SYNC) == -1 || rename(tmp_path, path) == -1) {
+        store_close(&store);
+        unlink(tmp_path);
+        return -1;
+    }
+    count = store.hdr->count;
+    store_close(&store);
+    return (int)count;
+}
+
+// Keeps the file at path as <path>.bak, replacing any older backup. The
+// backup is a hard link, so a store_save() over path leaves it untouched.
+int store_backup(const char *path) {
+    char backup[4096];
+
+    snprintf(backup, sizeof(backup), "%s.bak", path);
+    unlink(backup);
+    return link(path, backup);
+}
+
+// Rewrites an older file in the current format, sized for its longest name,
+// keeping the original as a backup
+static int store_upgrade(const char *path, int fd) {
+    struct store_record *records;
+    size_t count;
+    int result;
+
+    if (store_load_fd(fd, &records, &count) == -1)
+        return -1;
+    if (store_backup(path) == -1) {
+        free(records);
+        return -1;
+    }
+    result = store_save(path, records, count, store_fit_slot_size(records, count, STORE_SLOT_SIZE));
+    free(records);
+    return result;
+}
+
+// Opens path and write-locks the whole file for a rewrite. Fails with EBUSY
+// while any session has the file open, as it would go on using the replaced
+// file. Returns the descriptor (close it to unlock) or -1.
+int store_lock_exclusive(const char *path) {
+    struct store store = {0};
+
+    store.fd = open(path, O_RDWR);
+    if (store.fd == -1)
+        return -1;
+    lock_geometry(&store, F_WRLCK); // Sessions take their open lock under this
+    if (store_trylock(&store, F_WRLCK, STORE_LOCK_OPEN, 1) == -1) {
+        close(store.fd);
+        return -1;
+    }
+    store_lock(&store, F_WRLCK, 0, 0);
+    return store.fd;
+}
+
+// Opens (creating or converting as needed) the store at path, repairing
+// anything a crashed session left half-written. A converted file is kept as
+// <path>.bak; one that is in no format this code wrote is refused.
+// Returns 0 on success, -1 with errno set on failure.
+int store_open(struct store *store, const char *path) {
+    struct stat st, path_st;
+    struct store_header hdr;
+
+    memset(store, 0, sizeof(*store));
+    for (;;) {
+        store->fd = open(path, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+        if (store->fd == -1)
+            return -1;
+        lock_geometry(store, F_WRLCK);
+        if (fstat(store->fd, &st) == -1 || stat(path, &path_st) == -1)
+            goto fail;
+        if (st.st_ino != path_st.st_ino) { // Converted by another session while we waited
+            close(store->fd);
+            continue;
+        }
+
+        if (st.st_size == 0) {
+            if (store_format(store->fd, STORE_INITIAL_SLOTS, STORE_SLOT_SIZE) == -1)
+                goto fail;
+        } else if (pread(store->fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+                   hdr.magic != STORE_MAGIC || hdr.version < STORE_VERSION) {
+            if (store_trylock(store, F_WRLCK, STORE_LOCK_OPEN, 1) == -1 ||
+                store_upgrade(path, store->fd) == -1) // Legacy or older store
+                goto fail;
+            close(store->fd);
+            continue;
+        } else if (hdr.version > STORE_VERSION) { // Written by a newer version of this code
+            errno = ENOTSUP;
+            goto fail;
+        } else if (!header_valid(&hdr, st.st_size)) {
+            errno = EINVAL;
+            goto fail;
+        }
+        break;
+    }
+
+    store_lock(store, F_RDLCK, STORE_LOCK_OPEN, 1); // Held until store_close()
+    if (store_map(store) == -1)
+        goto fail;
+    // Holding the lock proves no live session is mid-update, so a flag that
+    // is still set was left by one that died
+    if (store->hdr->flags & STORE_INDEX_DIRTY) {
+        index_rebuild(store);
+        flag_clear(store, STORE_INDEX_DIRTY);
+    }
+    lock_board(store, F_WRLCK);
+    if (store->hdr->flags & STORE_BOARD_DIRTY) {
+        board_rebuild(store);
+        flag_clear(store, STORE_BOARD_DIRTY);
+    }
+    lock_board(store, F_UNLCK);
+    lock_geometry(store, F_UNLCK);
+    return 0;
+
+fail:
+    close(store->fd); // Also drops our locks
+    store->fd = -1;
+    return -1;
+}
+
+// Closes the store. Updates already live in the shared page cache, so this
+// only starts their writeback rather than waiting for it.
+void store_close(struct store *store) {
+    if (store->map != NULL) {
+        msync(store->map, store->map_size, MS_ASYNC);
+        munmap(store->map, store->map_size);
+    }
+    if (store->fd != -1)
+        close(store->fd);
+    store->map = NULL;
+    store->fd = -1;
+}
+
+// Starts writeback of everything changed through the mapping so far
+void store_sync(struct store *store) {
+    msync(store->map, store->map_size, MS_ASYNC);
+}
+
+// Returns the slot holding uid, or -1 if the player is not registered
+int store_find(struct store *store, int32_t uid) {
+    int slot = -1;
+
+    lock_geometry(store, F_RDLCK);
+    if (store_remap_if_grown(store) == 0)
+        slot = index_find(store, uid);
+    lock_geometry(store, F_UNLCK);
+    return slot;
+}
+
+// Doubles the slot capacity. Slots stay where they are; the index moves past
+// them and is rebuilt, with the dirty flag covering a crash part way through.
+// The flag is only cleared once the rebuilt index is on disk.
+static int store_grow(struct store *store) {
+    uint32_t capacity = store->hdr->capacity * 2;
+    uint32_t slot_size = store->hdr->slot_size;
+
+    flag_set(store, STORE_INDEX_DIRTY);
+    if (ftruncate(store->fd, store_file_size(capacity, slot_size, capacity * 2)) == -1)
+        return -1;
+    store->hdr->capacity = capacity;
+    store->hdr->buckets = capacity * 2;
+    if (store_map(store) == -1)
+        return -1;
+    index_rebuild(store);
+    flag_clear(store, STORE_INDEX_DIRTY);
+    return 0;
+}
+
+// Appends a new player record. Returns its slot, or -1 on failure. If another
+// session registered the same uid first, returns that slot instead.
+int store_insert(struct store *store, const struct store_record *record) {
+    uint32_t bucket;
+    int slot = -1;
+
+    lock_geometry(store, F_WRLCK);
+    if (store_remap_if_grown(store) == -1)
+        goto out;
+    if ((slot = index_find(store, record->uid)) != -1)
+        goto out;
+    if (store->hdr->count == store->hdr->capacity && store_grow(store) == -1)
+        goto out;
+
+    flag_set(store, STORE_INDEX_DIRTY);
+    board_begin(store);
+    slot = store->hdr->count;
+    record_encode(store_slot(store, slot), store->hdr->slot_size, record);
+    store->hdr->count++;
+    bucket = index_put(store, record->uid, slot);
+    board_offer(&store->hdr->board, record->uid, slot, record->highscore);
+    board_end(store);
+    store_persist(store, store_slot(store, slot), store->hdr->slot_size);
+    store_persist(store, &store->index[bucket], sizeof(uint32_t));
+    flag_clear(store, STORE_INDEX_DIRTY);
+
+out:
+    lock_geometry(store, F_UNLCK);
+    return slot;
+}
+
+// Applies a credit delta and optional new name to a slot under its record
+// lock, raising the high score to the new balance, then takes stake credits
+// if the record still holds that many. Returns -1, leaving the stake
+// untaken, if it does not.
+static int store_update(struct store *store, int slot, int32_t credit_delta, int32_t stake,
+                        const char *name, struct store_record *result) {
+    unsigned char *bytes = store_slot(store, slot);
+    uint32_t slot_size = store->hdr->slot_size;
+    struct store_record record;
+    int raised, taken;
+
+    lock_record(store, slot, F_WRLCK);
+    record_decode(bytes, slot_size, &record);
+    record.credits += credit_delta;
+    if (name != NULL)
+        snprintf(record.name, STORE_NAME_LEN, "%.*s", STORE_NAME_LEN - 1, name);
+    raised = record.credits > record.highscore;
+    if (raised)
+        record.highscore = record.credits;
+    taken = record.credits >= stake;
+    if (taken)
+        record.credits -= stake;
+    if (raised) {
+        board_begin(store);
+        record_encode(bytes, slot_size, &record);
+        board_offer(&store->hdr->board, record.uid, slot, record.highscore);
+        board_end(store);
+    } else {
+        record_encode(bytes, slot_size, &record);
+    }
+    record_decode(bytes, slot_size, result);
+    lock_record(store, slot, F_UNLCK);
+    return taken ? 0 : -1;
+}
+
+// Applies a player's changes to their slot. Credits are applied as a delta,
+// so rounds played concurrently by several sessions of the same player all
+// count. The name is replaced if one is given. The merged record is copied
+// to result.
+void store_apply(struct store *store, int slot, int32_t credit_delta, const char *name,
+                 struct store_record *result) {
+    store_update(store, slot, credit_delta, 0, name, result);
+}
+
+// Takes a wager from the stored record, so two sessions of one player can
+// never stake the same credits twice
+int store_reserve(struct store *store, int slot, int32_t stake, struct store_record *result) {
+    return store_update(store, slot, 0, stake, NULL, result);
+}
@@ -0,0 +1,131 @@
+#ifndef CHANCE_STORE_H
+#define CHANCE_STORE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// On-disk player store used by the Game of Chance.
+//
+// File layout:
+//   [ header, STORE_HEADER_SIZE bytes ]
+//   [ capacity fixed-size slots       ]  slot i at STORE_HEADER_SIZE + i * slot_size
+//   [ index: buckets x uint32_t       ]  uid hash -> slot + 1 (0 = empty bucket)
+//
+// Slot layout (version 3), little-endian, at the REC_* offsets below:
+//   uid, credits, highscore (int32 each), name length (uint8), name bytes.
+// The name is not NUL-terminated; the rest of the slot is zero. slot_size is
+// chosen per file, so a file whose names are short packs more slots per page.
+//
+// The header page also carries the leaderboard: a min-heap of the
+// STORE_BOARD_SIZE best high scores plus a small uid -> heap position table,
+// so raising a score costs O(log K) and reading the top scores never scans
+// the slots.
+//
+// The whole file is mmap()ed, so finding or updating a player touches only
+// the pages it needs. Slots never move; the index is derived from them and is
+// rebuilt whenever the header says it may be stale.
+//
+// Many game sessions share the file. They coordinate with fcntl() byte-range
+// locks: one byte for the geometry and index, one for the leaderboard, and
+// each slot's own bytes for its record, so sessions of different players
+// never wait on each other. Lock order is geometry, record, leaderboard.
+// Every open session also holds a read lock on one more byte for as long as
+// it has the file mapped; rewriting the file needs its write lock, so the
+// file is never replaced under a session that would keep using the old one.
+
+#define DATAFILE "/var/chance.data" // File to store user data
+
+#define STORE_MAGIC 0x434e4843      // "CHNC"
+#define STORE_VERSION 3
+#define STORE_HEADER_SIZE 4096
+#define STORE_INITIAL_SLOTS 64
+#define STORE_NAME_LEN 100         // Name buffer in struct store_record, with NUL
+#define STORE_SLOT_SIZE 112         // Slot size of new files: every name fits
+#define STORE_SLOT_ALIGN 16
+#define STORE_MAX_SLOT_SIZE 128
+#define STORE_BOARD_SIZE 128        // Players kept on the leaderboard
+#define STORE_BOARD_BUCKETS 256     // uid -> heap position table, a power of two
+
+#define REC_UID 0                   // Field offsets within a slot
+#define REC_CREDITS 4
+#define REC_HIGHSCORE 8
+#define REC_NAME_LEN 12
+#define REC_NAME 13
+
+#define STORE_LOCK_GEOMETRY 0       // Byte offsets locked to guard header state
+#define STORE_LOCK_BOARD 1
+#define STORE_LOCK_OPEN 2           // Read-locked by every open session
+
+#define STORE_INDEX_DIRTY 0x1       // Set while slots/index are being changed
+#define STORE_BOARD_DIRTY 0x2       // Set while a high score/leaderboard is being changed
+
+// A player record as the game sees it; slots hold it packed
+struct store_record {
+    int32_t uid;
+    int32_t credits;
+    int32_t highscore;
+    char name[STORE_NAME_LEN];
+};
+
+// A leaderboard entry
+struct store_board_entry {
+    int32_t uid;
+    uint32_t slot;
+    int32_t score;
+};
+
+// uid -> heap position bucket
+struct store_board_pos {
+    int32_t uid;
+    uint32_t pos;        // Heap position + 1, 0 = empty bucket
+};
+
+// Top-K high scores, kept as a min-heap on score
+struct store_board {
+    uint32_t count;
+    struct store_board_entry heap[STORE_BOARD_SIZE];
+    struct store_board_pos where[STORE_BOARD_BUCKETS];
+};
+
+// File header, at offset 0
+struct store_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slot_size;
+    uint32_t capacity;   // Slots the file has room for
+    uint32_t count;      // Slots in use
+    uint32_t buckets;    // Index buckets, a power of two
+    uint32_t flags;
+    struct store_board board;
+};
+
+// An open store
+struct store {
+    int fd;
+    char *map;
+    size_t map_size;
+    struct store_header *hdr;
+    uint32_t *index;
+};
+
+int store_open(struct store *store, const char *path);
+void store_close(struct store *store);
+void store_sync(struct store *store);
+int store_find(struct store *store, int32_t uid);
+int store_insert(struct store *store, const struct store_record *record);
+void store_get(struct store *store, int slot, struct store_record *record);
+int store_name_max(struct store *store);
+void store_apply(struct store *store, int slot, int32_t credit_delta, const char *name,
+                 struct store_record *result);
+int store_reserve(struct store *store, int slot, int32_t stake, struct store_record *result);
+int store_top(struct store *store, struct store_board_entry *top, int max);
+
+// Whole-file operations for migration and maintenance
+int store_load(const char *path, struct store_record **records, size_t *count);
+int store_load_fd(int fd, struct store_record **records, size_t *count);
+int store_save(const char *path, const struct store_record *records, size_t count, uint32_t slot_size);
+uint32_t store_fit_slot_size(const struct store_record *records, size_t count, uint32_t minimum);
+int store_lock_exclusive(const char *path);
+int store_backup(const char *path);
+
+#endif
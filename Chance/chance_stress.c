@@ -0,0 +1,285 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "chance_store.h"
+
+// Multi-process stress test for the player store: `make check`.
+// Forked sessions register and update a shared set of players at the same
+// time; afterwards every credit must be accounted for and the index and
+// leaderboard must agree with the slots. A second round SIGKILLs the
+// sessions mid-update and checks that reopening the store repairs it.
+
+#define STRESS_PLAYERS 64
+#define STRESS_PROCESSES 8
+#define STRESS_ROUNDS 20000
+#define STRESS_START_CREDITS 100
+#define STRESS_FIRST_UID 1000
+#define STRESS_NEW_UID 100000       // Players registered during the crash round
+#define STRESS_WAGER_UID 50000      // The player every session wagers for
+#define STRESS_WAGERS 20000
+#define STRESS_CRASH_ROUNDS 40
+#define STRESS_CRASH_MS 20          // How long each crash round runs before the kill
+
+// Credit updates applied per player and players registered, counted by the
+// children in shared memory
+struct stress_counts {
+    long applied[STRESS_PLAYERS];
+    long registered;
+    long staked, returned;      // Credits wagered and paid back by the wager round
+    int overdrawn;              // A wager round session saw negative credits
+};
+
+static int failures;
+
+static void check(int ok, const char *what) {
+    printf("%-4s %s\n", ok ? "ok" : "FAIL", what);
+    failures += !ok;
+}
+
+// Finds or registers uid, as a game session does
+static int find_or_register(struct store *store, int32_t uid) {
+    struct store_record record;
+    int slot = store_find(store, uid);
+
+    if (slot != -1)
+        return slot;
+    memset(&record, 0, sizeof(record));
+    record.uid = uid;
+    record.credits = record.highscore = STRESS_START_CREDITS;
+    snprintf(record.name, sizeof(record.name), "stress player %d", uid);
+    return store_insert(store, &record);
+}
+
+// One session: rounds credit updates of +1 spread over the shared players
+static void stress_child(const char *path, int child, struct stress_counts *counts) {
+    struct store store;
+    struct store_record record;
+    unsigned int seed = child * 7919 + 1;
+
+    if (store_open(&store, path) == -1) {
+        perror("store_open");
+        _exit(1);
+    }
+    for (int i = 0; i < STRESS_ROUNDS; i++) {
+        int player = rand_r(&seed) % STRESS_PLAYERS;
+        int slot = find_or_register(&store, STRESS_FIRST_UID + player);
+        if (slot == -1)
+            _exit(1);
+        store_apply(&store, slot, 1, NULL, &record);
+        __atomic_add_fetch(&counts->applied[player], 1, __ATOMIC_SEQ_CST);
+    }
+    store_close(&store);
+    _exit(0);
+}
+
+// One session of a player shared by all the others: stakes everything it
+// last saw, as a session with a stale balance would, and wins half the time
+static void wager_child(const char *path, int child, struct stress_counts *counts) {
+    struct store store;
+    struct store_record record;
+    unsigned int seed = child * 6151 + 1;
+    int slot;
+
+    if (store_open(&store, path) == -1 || (slot = find_or_register(&store, STRESS_WAGER_UID)) == -1)
+        _exit(1);
+    for (int i = 0; i < STRESS_WAGERS; i++) {
+        int32_t stake;
+        store_get(&store, slot, &record);
+        stake = record.credits > 0 ? record.credits : 1;
+        if (store_reserve(&store, slot, stake, &record) == -1)
+            continue;
+        __atomic_add_fetch(&counts->staked, stake, __ATOMIC_SEQ_CST);
+        if (record.credits < 0)
+            counts->overdrawn = 1;
+        if (rand_r(&seed) % 2) {
+            store_apply(&store, slot, 2 * stake, NULL, &record);
+            __atomic_add_fetch(&counts->returned, 2 * stake, __ATOMIC_SEQ_CST);
+        }
+    }
+    store_close(&store);
+    _exit(0);
+}
+
+// A session killed part way: keeps updating the shared players, and
+// registering new ones, until the parent kills it
+static void crash_child(const char *path, int child, struct stress_counts *counts) {
+    struct store store;
+    struct store_record record;
+    unsigned int seed = child * 104729 + 1;
+
+    if (store_open(&store, path) == -1)
+        _exit(1);
+    for (int i = 0;; i++) {
+        int player = rand_r(&seed) % STRESS_PLAYERS;
+        store_apply(&store, store_find(&store, STRESS_FIRST_UID + player), 1, NULL, &record);
+        __atomic_add_fetch(&counts->applied[player], 1, __ATOMIC_SEQ_CST);
+        if (i % 16 == 0) {
+            if (find_or_register(&store, STRESS_NEW_UID + child * 1000000 + i) == -1)
+                _exit(1);
+            __atomic_add_fetch(&counts->registered, 1, __ATOMIC_SEQ_CST);
+        }
+    }
+}
+
+static int compare_scores(const void *a, const void *b) {
+    int32_t x = *(const int32_t *)a, y = *(const int32_t *)b;
+    return (y > x) - (y < x);
+}
+
+// Checks the leaderboard against the high scores in the slots
+static int board_matches(struct store *store, const struct store_record *records, size_t count) {
+    struct store_board_entry top[STORE_BOARD_SIZE];
+    int32_t *scores = malloc((count ? count : 1) * sizeof(int32_t));
+    int shown = store_top(store, top, STORE_BOARD_SIZE), ok = 1;
+
+    for (size_t i = 0; i < count; i++)
+        scores[i] = records[i].highscore;
+    qsort(scores, count, sizeof(int32_t), compare_scores);
+    if ((size_t)shown != (count < STORE_BOARD_SIZE ? count : STORE_BOARD_SIZE))
+        ok = 0;
+    for (int i = 0; ok && i < shown; i++)
+        ok = top[i].score == scores[i];
+    free(scores);
+    return ok;
+}
+
+int main(void) {
+    char path[] = "/tmp/chance_stress.XXXXXX";
+    struct stress_counts *counts;
+    struct store store;
+    struct store_record *records;
+    size_t count;
+    long expected = 0, total = 0;
+    int fd, ok = 1;
+
+    if ((fd = mkstemp(path)) == -1) {
+        perror("mkstemp");
+        return 1;
+    }
+    close(fd);
+    counts = mmap(NULL, sizeof(*counts), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (counts == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    memset(counts, 0, sizeof(*counts));
+
+    printf("%d processes x %d rounds over %d players in %s\n",
+           STRESS_PROCESSES, STRESS_ROUNDS, STRESS_PLAYERS, path);
+    for (int c = 0; c < STRESS_PROCESSES; c++) {
+        if (fork() == 0)
+            stress_child(path, c, counts);
+    }
+    for (int c = 0; c < STRESS_PROCESSES; c++) {
+        int status;
+        wait(&status);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            ok = 0;
+    }
+    check(ok, "every session finished");
+
+    if (store_open(&store, path) == -1 || store_load_fd(store.fd, &records, &count) == -1) {
+        perror(path);
+        unlink(path);
+        return 1;
+    }
+    check(count == STRESS_PLAYERS, "each player registered exactly once");
+    ok = 1;
+    for (size_t i = 0; i < count; i++) {
+        int player = records[i].uid - STRESS_FIRST_UID;
+        if (player < 0 || player >= STRESS_PLAYERS ||
+            records[i].credits != STRESS_START_CREDITS + counts->applied[player] ||
+            records[i].highscore != records[i].credits ||
+            store_find(&store, records[i].uid) != (int)i)
+            ok = 0;
+        total += records[i].credits - STRESS_START_CREDITS;
+    }
+    for (int p = 0; p < STRESS_PLAYERS; p++)
+        expected += counts->applied[p];
+    printf("     %ld of %ld updates stored\n", total, expected);
+    check(ok && total == expected && expected == (long)STRESS_PROCESSES * STRESS_ROUNDS,
+          "no credit updates lost");
+    check(board_matches(&store, records, count), "leaderboard matches the slots");
+    free(records);
+    store_close(&store);
+
+    // Wager round
+    printf("%d processes x %d wagers of one player's whole balance\n", STRESS_PROCESSES, STRESS_WAGERS);
+    ok = 1;
+    for (int c = 0; c < STRESS_PROCESSES; c++) {
+        if (fork() == 0)
+            wager_child(path, c, counts);
+    }
+    for (int c = 0; c < STRESS_PROCESSES; c++) {
+        int status;
+        wait(&status);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            ok = 0;
+    }
+    if (store_open(&store, path) == -1) {
+        perror(path);
+        unlink(path);
+        return 1;
+    }
+    struct store_record wagered;
+    store_get(&store, store_find(&store, STRESS_WAGER_UID), &wagered);
+    store_close(&store);
+    check(ok && !counts->overdrawn && wagered.credits >= 0, "no wager overdrew the player");
+    check(wagered.credits == STRESS_START_CREDITS - counts->staked + counts->returned,
+          "every wager accounted for");
+
+    // Crash rounds. A killed session may have stored its last update or
+    // registration without counting it, so each kill can leave the store
+    // one ahead of the counts.
+    printf("%d rounds of %d processes killed after %d ms\n", STRESS_CRASH_ROUNDS, STRESS_PROCESSES, STRESS_CRASH_MS);
+    int recovered = 1, registered = 1, indexed = 1, counted = 1, ranked = 1;
+    for (int round = 1; round <= STRESS_CRASH_ROUNDS; round++) {
+        pid_t children[STRESS_PROCESSES];
+        size_t slack = (size_t)round * STRESS_PROCESSES;
+
+        for (int c = 0; c < STRESS_PROCESSES; c++) {
+            if ((children[c] = fork()) == 0)
+                crash_child(path, round * STRESS_PROCESSES + c, counts);
+        }
+        usleep(STRESS_CRASH_MS * 1000);
+        for (int c = 0; c < STRESS_PROCESSES; c++)
+            kill(children[c], SIGKILL);
+        for (int c = 0; c < STRESS_PROCESSES; c++)
+            waitpid(children[c], NULL, 0);
+
+        if (store_open(&store, path) == -1 || store_load_fd(store.fd, &records, &count) == -1) {
+            perror(path);
+            unlink(path);
+            return 1;
+        }
+        recovered &= store.hdr->flags == 0;
+        registered &= count >= STRESS_PLAYERS + 1 + (size_t)counts->registered &&
+                      count <= STRESS_PLAYERS + 1 + (size_t)counts->registered + slack;
+        total = expected = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (store_find(&store, records[i].uid) != (int)i || records[i].highscore < records[i].credits)
+                indexed = 0;
+            if (records[i].uid < STRESS_FIRST_UID + STRESS_PLAYERS)
+                total += records[i].credits - STRESS_START_CREDITS;
+        }
+        for (int p = 0; p < STRESS_PLAYERS; p++)
+            expected += counts->applied[p];
+        counted &= total >= expected && total <= expected + (long)slack;
+        ranked &= board_matches(&store, records, count);
+        free(records);
+        store_close(&store);
+    }
+    printf("     %ld stored for %ld counted updates\n", total, expected);
+    check(recovered, "reopening cleared the dirty flags");
+    check(registered, "registrations survived the crashes");
+    check(indexed, "index finds every slot after the crashes");
+    check(counted, "no credit updates lost in the crashes");
+    check(ranked, "leaderboard matches the slots after the crashes");
+
+    unlink(path);
+    return failures ? 1 : 0;
+}
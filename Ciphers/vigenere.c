@@ -2,21 +2,31 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
 #include <time.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #define AES_BLOCK_SIZE 16
 #define AES_KEY_SIZE 32
 
+#define CRACK_MAX_KEY_LENGTH 64     // Longest key length considered by --crack
+#define CRACK_SAMPLE_LETTERS (1 << 18) // Letters used to estimate the key length
+#define CRACK_MAX_THREADS 32
+#define IOC_RANDOM (1.0 / 26)
+#define CRACK_IOC_MARGIN 0.1        // Fraction of the best IoC's lead over random text
+#define CRACK_MIN_COLUMN 50         // Letters per column below which IoC is too noisy to use
+
 // Key Derivation: A simple key derivation function
 void derive_aes_key(const char *passphrase, unsigned char *aes_key) {
     size_t pass_len = strlen(passphrase);
     for (size_t i = 0; i < AES_KEY_SIZE; i++) {
-        aes_key[i] = (i < pass_len) ? passphrase[i] : i;
+        aes_key[i] = (i < pass_len) ? (unsigned char)passphrase[i] : (unsigned char)i;
     }
 }
 
 // XOR-based "AES-like" encryption (for demonstration)
-void aes_encrypt(const unsigned char *plaintext, int plaintext_len, const unsigned char *key, unsigned char *ciphertext, unsigned char *iv) {
+void aes_encrypt(const unsigned char *plaintext, int plaintext_len, const unsigned char *key, unsigned char *ciphertext, const unsigned char *iv) {
     for (int i = 0; i < plaintext_len; i++) {
         ciphertext[i] = plaintext[i] ^ key[i % AES_KEY_SIZE] ^ iv[i % AES_BLOCK_SIZE];
     }
@@ -48,10 +58,16 @@ char *base64_encode(const unsigned char *input, int length) {
 }
 
 // Vigenère Cipher Functions
+
+// Returns the alphabet base of a letter ('A' or 'a'), or 0 for non-letters
+static char alpha_base(char c) {
+    return isupper((unsigned char)c) ? 'A' : (islower((unsigned char)c) ? 'a' : 0);
+}
+
 void vigenere_encrypt(const char *plaintext, const char *key, char *ciphertext) {
     int key_length = strlen(key);
     for (int i = 0, j = 0; plaintext[i] != '\0'; i++) {
-        char base = isupper(plaintext[i]) ? 'A' : (islower(plaintext[i]) ? 'a' : 0);
+        char base = alpha_base(plaintext[i]);
         if (base) {
             ciphertext[i] = ((plaintext[i] - base + (toupper(key[j % key_length]) - 'A')) % 26) + base;
             j++;
@@ -65,7 +81,7 @@ void vigenere_encrypt(const char *plaintext, const char *key, char *ciphertext)
 void vigenere_decrypt(const char *ciphertext, const char *key, char *plaintext) {
     int key_length = strlen(key);
     for (int i = 0, j = 0; ciphertext[i] != '\0'; i++) {
-        char base = isupper(ciphertext[i]) ? 'A' : (islower(ciphertext[i]) ? 'a' : 0);
+        char base = alpha_base(ciphertext[i]);
         if (base) {
             plaintext[i] = ((ciphertext[i] - base - (toupper(key[j % key_length]) - 'A') + 26) % 26) + base;
             j++;
@@ -76,8 +92,431 @@ void vigenere_decrypt(const char *ciphertext, const char *key, char *plaintext)
     plaintext[strlen(ciphertext)] = '\0';
 }
 
+// ========================= Prepared Vigenère Keys ==========================
+
+#define VIGENERE_KERNEL_LENGTHS 16  // Key lengths 1..N get a kernel of their own
+
+// A key compiled once for one direction. Row j of the table is the whole
+// substitution for key letter j, so the kernels do one lookup per byte:
+// bytes that are not letters map to themselves and do not advance the key.
+struct vigenere_key {
+    int length;
+    void (*kernel)(const struct vigenere_key *key, const char *input, char *output);
+    unsigned char advance[256];     // 1 for letters, 0 otherwise
+    unsigned char table[][256];     // length rows
+};
+
+// Shared kernel body. Each caller passes its length as a constant, so the
+// wrap-around compiles to a compare with an immediate and the loop is
+// specialised per length.
+static inline __attribute__((always_inline))
+void vigenere_kernel(const struct vigenere_key *key, int length, const char *input, char *output) {
+    const unsigned char *in = (const unsigned char *)input;
+    size_t i;
+    int j = 0;
+
+    for (i = 0; in[i] != '\0'; i++) {
+        output[i] = key->table[j][in[i]];
+        j += key->advance[in[i]];
+        if (j == length)
+            j = 0;
+    }
+    output[i] = '\0';
+}
+
+#define VIGENERE_KERNEL(N) \
+    static void vigenere_kernel_##N(const struct vigenere_key *key, const char *input, char *output) { \
+        vigenere_kernel(key, N, input, output); \
+    }
+
+VIGENERE_KERNEL(1)  VIGENERE_KERNEL(2)  VIGENERE_KERNEL(3)  VIGENERE_KERNEL(4)
+VIGENERE_KERNEL(5)  VIGENERE_KERNEL(6)  VIGENERE_KERNEL(7)  VIGENERE_KERNEL(8)
+VIGENERE_KERNEL(9)  VIGENERE_KERNEL(10) VIGENERE_KERNEL(11) VIGENERE_KERNEL(12)
+VIGENERE_KERNEL(13) VIGENERE_KERNEL(14) VIGENERE_KERNEL(15) VIGENERE_KERNEL(16)
+
+// Any other length
+static void vigenere_kernel_any(const struct vigenere_key *key, const char *input, char *output) {
+    vigenere_kernel(key, key->length, input, output);
+}
+
+static void (*const vigenere_kernels[VIGENERE_KERNEL_LENGTHS + 1])(const struct vigenere_key *, const char *, char *) = {
+    NULL, vigenere_kernel_1, vigenere_kernel_2, vigenere_kernel_3, vigenere_kernel_4,
+    vigenere_kernel_5, vigenere_kernel_6, vigenere_kernel_7, vigenere_kernel_8,
+    vigenere_kernel_9, vigenere_kernel_10, vigenere_kernel_11, vigenere_kernel_12,
+    vigenere_kernel_13, vigenere_kernel_14, vigenere_kernel_15, vigenere_kernel_16
+};
+
+// Compiles key for encryption (decrypt = 0) or decryption (decrypt = 1).
+// The output matches vigenere_encrypt()/vigenere_decrypt() byte for byte.
+// Returns NULL for an empty key or if out of memory; free() the result.
+struct vigenere_key *vigenere_prepare(const char *key, int decrypt) {
+    int length = strlen(key);
+    struct vigenere_key *prepared;
+
+    if (length == 0)
+        return NULL;
+    prepared = malloc(sizeof(*prepared) + (size_t)length * 256);
+    if (prepared == NULL)
+        return NULL;
+    prepared->length = length;
+    prepared->kernel = (length <= VIGENERE_KERNEL_LENGTHS) ? vigenere_kernels[length] : vigenere_kernel_any;
+
+    for (int c = 0; c < 256; c++)
+        prepared->advance[c] = alpha_base((char)c) != 0;
+    for (int j = 0; j < length; j++) {
+        int shift = toupper((unsigned char)key[j]) - 'A';
+        for (int c = 0; c < 256; c++) {
+            char base = alpha_base((char)c);
+            if (!base)
+                prepared->table[j][c] = c;
+            else if (decrypt)
+                prepared->table[j][c] = (((char)c - base - shift + 26) % 26) + base;
+            else
+                prepared->table[j][c] = (((char)c - base + shift) % 26) + base;
+        }
+    }
+    return prepared;
+}
+
+// Runs one message through a prepared key; output needs strlen(input) + 1 bytes
+void vigenere_apply(const struct vigenere_key *key, const char *input, char *output) {
+    key->kernel(key, input, output);
+}
+
+// Runs count messages through one prepared key. Each message starts at the
+// first key letter, exactly as if it were passed to vigenere_apply() alone.
+void vigenere_apply_batch(const struct vigenere_key *key, const char *const *inputs, char *const *outputs, size_t count) {
+    void (*kernel)(const struct vigenere_key *, const char *, char *) = key->kernel;
+
+    for (size_t i = 0; i < count; i++)
+        kernel(key, inputs[i], outputs[i]);
+}
+
+// ========================== Vigenère Cryptanalysis ==========================
+
+// Relative letter frequencies of English text, A to Z
+static const double english_freq[26] = {
+    0.08167, 0.01492, 0.02782, 0.04253, 0.12702, 0.02228, 0.02015, 0.06094, 0.06966,
+    0.00153, 0.00772, 0.04025, 0.02406, 0.06749, 0.07507, 0.01929, 0.00095, 0.05987,
+    0.06327, 0.09056, 0.02758, 0.00978, 0.02360, 0.00150, 0.01974, 0.00074
+};
+
+// Strips a ciphertext down to its letters as values 0-25, using the same
+// alphabet rules as vigenere_decrypt(). Returns the number of letters kept.
+size_t extract_letters(const char *text, size_t text_len, unsigned char *letters) {
+    size_t n = 0;
+    for (size_t i = 0; i < text_len; i++) {
+        char base = alpha_base(text[i]);
+        if (base)
+            letters[n++] = text[i] - base;
+    }
+    return n;
+}
+
+// Builds a 26-bin histogram for each of the key_length columns of the text.
+// Consecutive rows go to one of four banks so that a letter repeating in the
+// same column never waits on the previous increment of the same counter; the
+// inner loop has no modulo and unrolls cleanly.
+void column_histograms(const unsigned char *letters, size_t n, int key_length, unsigned int *hist) {
+    unsigned int *banks = calloc(4 * (size_t)key_length * 26, sizeof(unsigned int));
+    size_t bank_size = (size_t)key_length * 26;
+    size_t row = 0, i = 0;
+
+    if (banks == NULL) {
+        fprintf(stderr, "Error: out of memory while counting letters.\n");
+        exit(1);
+    }
+
+    for (; i + key_length <= n; i += key_length, row++) {
+        unsigned int *bank = banks + (row & 3) * bank_size;
+        const unsigned char *p = letters + i;
+        for (int col = 0; col < key_length; col++)
+            bank[col * 26 + p[col]]++;
+    }
+    for (int col = 0; i < n; i++, col++)
+        banks[col * 26 + letters[i]]++;
+
+    for (size_t k = 0; k < bank_size; k++)
+        hist[k] = banks[k] + banks[bank_size + k] + banks[2 * bank_size + k] + banks[3 * bank_size + k];
+    free(banks);
+}
+
+// Average index of coincidence over the columns of a candidate key length
+double average_ioc(const unsigned char *letters, size_t n, int key_length) {
+    unsigned int hist[CRACK_MAX_KEY_LENGTH * 26];
+    double total = 0.0;
+
+    column_histograms(letters, n, key_length, hist);
+    for (int col = 0; col < key_length; col++) {
+        unsigned long column_len = 0, pairs = 0;
+        for (int c = 0; c < 26; c++) {
+            unsigned long count = hist[col * 26 + c];
+            column_len += count;
+            pairs += count * (count - 1);
+        }
+        if (column_len > 1)
+            total += (double)pairs / ((double)column_len * (column_len - 1));
+    }
+    return total / key_length;
+}
+
+// Kasiski examination: for every repeated trigram, counts how many candidate
+// key lengths divide the distance back to its previous occurrence. Distances
+// are tallied first so each candidate only walks its own multiples.
+void kasiski_counts(const unsigned char *letters, size_t n, int max_length, unsigned long *counts) {
+    int *last_seen = malloc(26 * 26 * 26 * sizeof(int));
+    unsigned int *distances = calloc(n + 1, sizeof(unsigned int));
+
+    if (last_seen == NULL || distances == NULL) {
+        fprintf(stderr, "Error: out of memory during Kasiski examination.\n");
+        exit(1);
+    }
+    memset(last_seen, -1, 26 * 26 * 26 * sizeof(int));
+    memset(counts, 0, (max_length + 1) * sizeof(unsigned long));
+
+    for (size_t i = 0; i + 2 < n; i++) {
+        int trigram = (letters[i] * 26 + letters[i + 1]) * 26 + letters[i + 2];
+        if (last_seen[trigram] >= 0)
+            distances[i - last_seen[trigram]]++;
+        last_seen[trigram] = (int)i;
+    }
+    for (int len = 2; len <= max_length; len++) {
+        for (size_t d = len; d <= n; d += len)
+            counts[len] += distances[d];
+    }
+    free(distances);
+    free(last_seen);
+}
+
+// Work shared by the key length estimation threads
+struct ioc_job {
+    const unsigned char *letters;
+    size_t n;
+    int max_length;
+    int first_length;
+    int step;
+    double *ioc;
+};
+
+void *ioc_worker(void *arg) {
+    struct ioc_job *job = arg;
+    for (int len = job->first_length; len <= job->max_length; len += job->step)
+        job->ioc[len] = average_ioc(job->letters, job->n, len);
+    return NULL;
+}
+
+// Estimates the key length. Every candidate length is scored by index of
+// coincidence, spread across all cores. Multiples of the true length score as
+// well as it does and its divisors score worse, so the answer is the smallest
+// length within CRACK_IOC_MARGIN of the best score. Kasiski support only
+// decides between candidates that are not multiples of one another; a
+// divisor always has at least the support of its multiples, so letting it
+// rank them would pick the divisor.
+int estimate_key_length(const unsigned char *letters, size_t n, int max_length) {
+    double ioc[CRACK_MAX_KEY_LENGTH + 1] = {0};
+    unsigned long kasiski[CRACK_MAX_KEY_LENGTH + 1];
+    struct ioc_job jobs[CRACK_MAX_THREADS];
+    pthread_t threads[CRACK_MAX_THREADS];
+    int started[CRACK_MAX_THREADS];
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int thread_count = (cpus < 1) ? 1 : (cpus > CRACK_MAX_THREADS ? CRACK_MAX_THREADS : (int)cpus);
+    int best_length = 1;
+    double best_ioc = 0.0, threshold;
+
+    if (n > CRACK_SAMPLE_LETTERS)
+        n = CRACK_SAMPLE_LETTERS; // The statistics settle long before this
+    if (thread_count > max_length)
+        thread_count = max_length;
+
+    for (int t = 0; t < thread_count; t++) {
+        jobs[t] = (struct ioc_job){letters, n, max_length, t + 1, thread_count, ioc};
+        started[t] = pthread_create(&threads[t], NULL, ioc_worker, &jobs[t]) == 0;
+        if (!started[t])
+            ioc_worker(&jobs[t]); // Fall back to doing this share ourselves
+    }
+    kasiski_counts(letters, n, max_length, kasiski);
+    for (int t = 0; t < thread_count; t++) {
+        if (started[t])
+            pthread_join(threads[t], NULL);
+    }
+
+    for (int len = 1; len <= max_length; len++) {
+        if (ioc[len] > best_ioc)
+            best_ioc = ioc[len];
+    }
+    threshold = best_ioc - CRACK_IOC_MARGIN * (best_ioc - IOC_RANDOM);
+    kasiski[1] = 0;
+
+    best_length = 0;
+    for (int len = 1; len <= max_length; len++) {
+        if (ioc[len] < threshold)
+            continue;
+        if (best_length != 0 && len % best_length == 0)
+            continue; // A multiple of the length already chosen
+        if (best_length == 0 || kasiski[len] > kasiski[best_length])
+            best_length = len;
+    }
+    return best_length ? best_length : 1;
+}
+
+// Recovers each key letter by picking the shift whose decrypted column has
+// the lowest chi-squared distance from English letter frequencies.
+void recover_key(const unsigned char *letters, size_t n, int key_length, char *key) {
+    unsigned int *hist = malloc((size_t)key_length * 26 * sizeof(unsigned int));
+
+    if (hist == NULL) {
+        fprintf(stderr, "Error: out of memory while recovering the key.\n");
+        exit(1);
+    }
+    column_histograms(letters, n, key_length, hist);
+
+    for (int col = 0; col < key_length; col++) {
+        const unsigned int *counts = hist + col * 26;
+        unsigned long column_len = 0;
+        double best_chi = -1.0;
+        int best_shift = 0;
+
+        for (int c = 0; c < 26; c++)
+            column_len += counts[c];
+
+        for (int shift = 0; shift < 26 && column_len > 0; shift++) {
+            double chi = 0.0;
+            for (int c = 0; c < 26; c++) {
+                double expected = english_freq[c] * column_len;
+                double diff = counts[(c + shift) % 26] - expected;
+                chi += diff * diff / expected;
+            }
+            if (best_chi < 0 || chi < best_chi) {
+                best_chi = chi;
+                best_shift = shift;
+            }
+        }
+        key[col] = 'A' + best_shift;
+    }
+    key[key_length] = '\0';
+    free(hist);
+}
+
+// Reads an entire file (or stdin for "-") into a NUL-terminated buffer
+char *read_whole_file(const char *filename, size_t *length) {
+    FILE *fp = strcmp(filename, "-") == 0 ? stdin : fopen(filename, "rb");
+    size_t capacity = 1 << 16, used = 0, got;
+    char *buffer;
+
+    if (fp == NULL) {
+        perror(filename);
+        return NULL;
+    }
+    buffer = malloc(capacity);
+    while (buffer != NULL && (got = fread(buffer + used, 1, capacity - used - 1, fp)) > 0) {
+        used += got;
+        if (capacity - used - 1 == 0) {
+            char *bigger = realloc(buffer, capacity * 2);
+            if (bigger == NULL) {
+                free(buffer);
+                buffer = NULL;
+            }
+            buffer = bigger;
+            capacity *= 2;
+        }
+    }
+    if (fp != stdin)
+        fclose(fp);
+    if (buffer == NULL) {
+        fprintf(stderr, "Error: out of memory while reading %s.\n", filename);
+        return NULL;
+    }
+    buffer[used] = '\0';
+    *length = used;
+    return buffer;
+}
+
+// Cryptanalysis mode: recovers the key of a Vigenère ciphertext and decrypts it
+int crack_vigenere(const char *filename, const char *output) {
+    size_t text_len, n;
+    char *ciphertext, *plaintext = NULL, key[CRACK_MAX_KEY_LENGTH + 1];
+    unsigned char *letters = NULL;
+    struct vigenere_key *prepared;
+    struct timespec start, end;
+    int key_length, max_length, result = 1;
+
+    ciphertext = read_whole_file(filename, &text_len);
+    if (ciphertext == NULL)
+        return 1;
+    if (memchr(ciphertext, '\0', text_len) != NULL) { // The ciphers stop at the first NUL
+        fprintf(stderr, "Error: %s contains NUL bytes; --crack reads text.\n", filename);
+        free(ciphertext);
+        return 1;
+    }
+    letters = malloc(text_len + 1);
+    plaintext = malloc(text_len + 1);
+    if (letters == NULL || plaintext == NULL) {
+        fprintf(stderr, "Error: out of memory.\n");
+        goto out;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    n = extract_letters(ciphertext, text_len, letters);
+    if (n < 2) {
+        fprintf(stderr, "Error: not enough letters to analyse.\n");
+        goto out;
+    }
+    max_length = (n / CRACK_MIN_COLUMN < CRACK_MAX_KEY_LENGTH) ? (int)(n / CRACK_MIN_COLUMN) : CRACK_MAX_KEY_LENGTH;
+    if (max_length < 1)
+        max_length = 1;
+    key_length = estimate_key_length(letters, n, max_length);
+    recover_key(letters, n, key_length, key);
+    prepared = vigenere_prepare(key, 1);
+    if (prepared == NULL) {
+        fprintf(stderr, "Error: out of memory.\n");
+        goto out;
+    }
+    vigenere_apply(prepared, ciphertext, plaintext);
+    free(prepared);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    printf("Letters analysed: %zu\n", n);
+    printf("Estimated key length: %d\n", key_length);
+    printf("Recovered key: %s\n", key);
+    printf("Cryptanalysis Time: %.2f ms\n",
+           (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6);
+
+    if (output != NULL) {
+        FILE *fp = fopen(output, "wb");
+        int written;
+
+        if (fp == NULL) {
+            perror(output);
+            goto out;
+        }
+        written = fwrite(plaintext, 1, text_len, fp) == text_len;
+        if (fclose(fp) != 0 || !written) { // fclose() reports errors from the final flush
+            fprintf(stderr, "Error: could not write %s: %s\n", output, strerror(errno));
+            goto out;
+        }
+        printf("Plaintext written to %s\n", output);
+    } else {
+        printf("Decrypted Plaintext (first 200 characters): %.200s\n", plaintext);
+    }
+    result = 0;
+
+out:
+    free(letters);
+    free(plaintext);
+    free(ciphertext);
+    return result;
+}
+
+#ifndef VIGENERE_NO_MAIN // vigenere_check.c builds the functions above without it
 // Main Program
-int main() {
+int main(int argc, char *argv[]) {
+    if (argc > 1) {
+        if (strcmp(argv[1], "--crack") == 0 && argc > 2)
+            return crack_vigenere(argv[2], argc > 3 ? argv[3] : NULL);
+        fprintf(stderr, "Usage: %s [--crack <ciphertext file|-> [plaintext output]]\n", argv[0]);
+        return 1;
+    }
+
     char plaintext[1024], vigenere_key[256], vigenere_cipher[1024];
     unsigned char aes_key[AES_KEY_SIZE], aes_cipher[2048], aes_decrypted[2048], iv[AES_BLOCK_SIZE] = {0};
     char passphrase[256];
@@ -137,5 +576,6 @@ int main() {
     free(base64_cipher);
     return 0;
 }
+#endif
 
 
@@ -0,0 +1,154 @@
+// Regression checks for the Vigenère cryptanalysis: `make check`
+#define VIGENERE_NO_MAIN
+#include "vigenere.c"
+
+#define CHECK_LETTERS 40000
+
+// Fills text with words of letters drawn from English frequencies, using a
+// fixed LCG so every run sees the same text
+static void english_like_text(char *text, size_t length) {
+    unsigned int state = 12345;
+
+    for (size_t i = 0; i < length; i++) {
+        double r, sum = 0.0;
+        int c = 0;
+
+        state = state * 1103515245u + 12345u;
+        if ((state >> 16) % 6 == 0) {
+            text[i] = ' ';
+            continue;
+        }
+        state = state * 1103515245u + 12345u;
+        r = (state >> 8) / (double)(1u << 24);
+        while (c < 25 && (sum += english_freq[c]) < r)
+            c++;
+        text[i] = 'a' + c;
+    }
+    text[length] = '\0';
+}
+
+// Encrypts text under key and checks that --crack's steps recover it
+static int check_key(const char *text, size_t length, const char *key) {
+    char *ciphertext = malloc(length + 1), recovered[CRACK_MAX_KEY_LENGTH + 1];
+    unsigned char *letters = malloc(length);
+    size_t n;
+    int key_length, ok;
+
+    if (ciphertext == NULL || letters == NULL) {
+        fprintf(stderr, "Error: out of memory.\n");
+        exit(1);
+    }
+    vigenere_encrypt(text, key, ciphertext);
+    n = extract_letters(ciphertext, length, letters);
+    key_length = estimate_key_length(letters, n, CRACK_MAX_KEY_LENGTH);
+    recover_key(letters, n, key_length, recovered);
+
+    ok = strcmp(recovered, key) == 0;
+    printf("%-4s key %-16s (length %2zu): recovered %s\n", ok ? "ok" : "FAIL", key, strlen(key), recovered);
+    free(letters);
+    free(ciphertext);
+    return ok;
+}
+
+// Fills text with mixed-case letters, digits, punctuation and high bytes,
+// using a fixed LCG
+static void mixed_text(char *text, size_t length, unsigned int state) {
+    static const char other[] = " .,;:!?'-0123456789\n\t\xe9\xff";
+
+    for (size_t i = 0; i < length; i++) {
+        state = state * 1103515245u + 12345u;
+        if ((state >> 16) % 4 == 0)
+            text[i] = other[(state >> 8) % (sizeof(other) - 1)];
+        else
+            text[i] = (((state >> 20) & 1) ? 'A' : 'a') + (state >> 8) % 26;
+    }
+    text[length] = '\0';
+}
+
+// Checks that a prepared key, alone and in a batch, gives exactly what
+// vigenere_encrypt()/vigenere_decrypt() give, in both directions
+static int check_prepared(const char *text, size_t length, const char *key) {
+    enum { PARTS = 8 };
+    char *expected = malloc(length + 1), *output = malloc(length + 1 + PARTS), *inputs_buf = malloc(length + PARTS);
+    const char *inputs[PARTS];
+    char *outputs[PARTS];
+    int ok = 1;
+
+    if (expected == NULL || output == NULL || inputs_buf == NULL) {
+        fprintf(stderr, "Error: out of memory.\n");
+        exit(1);
+    }
+    for (int decrypt = 0; decrypt <= 1; decrypt++) {
+        struct vigenere_key *prepared = vigenere_prepare(key, decrypt);
+        size_t start = 0, offset = 0;
+
+        if (prepared == NULL) {
+            fprintf(stderr, "Error: out of memory.\n");
+            exit(1);
+        }
+        if (decrypt)
+            vigenere_decrypt(text, key, expected);
+        else
+            vigenere_encrypt(text, key, expected);
+        vigenere_apply(prepared, text, output);
+        ok &= memcmp(output, expected, length + 1) == 0;
+
+        // Uneven messages, the first of them empty, each starting the key over
+        for (int m = 0; m < PARTS; m++) {
+            size_t end = (m == PARTS - 1) ? length : start + m * m * length / 200;
+            memcpy(inputs_buf + offset, text + start, end - start);
+            inputs_buf[offset + end - start] = '\0';
+            inputs[m] = inputs_buf + offset;
+            outputs[m] = output + offset;
+            offset += end - start + 1;
+            start = end;
+        }
+        vigenere_apply_batch(prepared, inputs, outputs, PARTS);
+        for (int m = 0; m < PARTS; m++) {
+            if (decrypt)
+                vigenere_decrypt(inputs[m], key, expected);
+            else
+                vigenere_encrypt(inputs[m], key, expected);
+            ok &= strcmp(outputs[m], expected) == 0;
+        }
+        free(prepared);
+    }
+    printf("%-4s prepared key %-23s (length %2zu) matches encrypt/decrypt\n", ok ? "ok" : "FAIL", key, strlen(key));
+    free(inputs_buf);
+    free(output);
+    free(expected);
+    return ok;
+}
+
+int main(void) {
+    // Composite lengths whose divisors also score above random text
+    const char *keys[] = { "SECRET", "CRYPTOGRAPHY", "WHITEHATHACKER", "ABCABD", "LEMON", "KEY" };
+    char *text = malloc(CHECK_LETTERS + 1);
+    int failures = 0;
+
+    if (text == NULL)
+        return 1;
+    english_like_text(text, CHECK_LETTERS);
+    for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++)
+        failures += !check_key(text, CHECK_LETTERS, keys[i]);
+    free(text);
+
+    // Every specialised kernel length, one that takes the generic kernel,
+    // and keys with non-letters in them
+    text = malloc(CHECK_LETTERS + 1);
+    if (text == NULL)
+        return 1;
+    mixed_text(text, CHECK_LETTERS, 54321);
+    for (int length = 1; length <= VIGENERE_KERNEL_LENGTHS + 1; length++) {
+        char key[VIGENERE_KERNEL_LENGTHS + 8];
+        int key_length = (length > VIGENERE_KERNEL_LENGTHS) ? 23 : length;
+        mixed_text(key, key_length, length);
+        for (int j = 0; j < key_length; j++)
+            key[j] = ((j & 1) ? 'a' : 'A') + (unsigned char)key[j] % 26;
+        failures += !check_prepared(text, CHECK_LETTERS, key);
+    }
+    failures += !check_prepared(text, CHECK_LETTERS, "Key 2!");
+    failures += !check_prepared(text, CHECK_LETTERS, "lemon-tree");
+    free(text);
+    return failures ? 1 : 0;
+}